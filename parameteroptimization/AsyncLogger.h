@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+namespace opt {
+
+/**
+ * writes log lines to a log file and to the console from a background thread.
+ * lines are passed through a lock-free ring buffer, so log() only blocks if
+ * the buffer is full. the timestamp of a line is taken when it is enqueued.
+ * all enqueued lines are written before the destructor returns.
+ *
+ * lines captured by a StdioHandler are only enqueued once its reader thread
+ * has read them from the pipe. their timestamp is the time they were read,
+ * which can lag behind the time they were printed when the process is busy.
+ *
+ * the console output goes to duplicates of stdout and stderr taken at
+ * construction time, i.e. it is not affected by a StdioHandler that is
+ * installed later.
+ */
+class AsyncLogger {
+  public:
+    enum class Level {
+        Info,
+        Error
+    };
+
+    explicit AsyncLogger(boost::filesystem::path const& logfile, size_t capacity = 4096);
+    ~AsyncLogger();
+
+    AsyncLogger(AsyncLogger const&) = delete;
+    AsyncLogger& operator=(AsyncLogger const&) = delete;
+
+    // safe to call from multiple threads
+    void log(Level level, std::string line);
+
+  private:
+    struct Entry {
+        std::atomic<size_t> sequence;
+        std::chrono::system_clock::time_point time;
+        Level level;
+        std::string line;
+    };
+
+    // returns false if the buffer is empty
+    bool writeNext();
+    void drain();
+
+    std::unique_ptr<Entry[]> _entries;
+    const size_t _mask;
+
+    std::atomic<size_t> _enqueuePosition;
+    // only used by the background thread
+    size_t _dequeuePosition;
+
+    std::ofstream _logfile;
+    int _stdoutFd;
+    int _stderrFd;
+
+    std::atomic<bool> _stop;
+    std::thread _thread;
+};
+}
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <functional>
+#include <sstream>
 #include <type_traits>
 #include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/optional.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 #include <pipeline/util/GroundTruthEvaluator.h>
 #include <pipeline/util/Util.h>
@@ -40,13 +44,29 @@ struct path_struct_t {
 };
 typedef std::vector<path_struct_t> task_vector_t;
 
+// images of a ground truth file that exist. images can be missing, so the
+// position of an image in imagePaths is not necessarily its frame number.
+struct ground_truth_images_t {
+    std::vector<boost::filesystem::path> imagePaths;
+    // frame number of every image, i.e. its index in the file names of the
+    // ground truth file
+    std::vector<size_t> frameNumbers;
+    // number of frames of the ground truth file, including the frames
+    // whose image is missing
+    size_t numFrames;
+
+    ground_truth_images_t() : numFrames(0) {}
+};
+
 struct multiple_path_struct_t {
-    typedef std::vector<boost::filesystem::path> path_vector_t;
+    typedef std::map<boost::filesystem::path, ground_truth_images_t> images_by_ground_truth_t;
 
-    std::map<boost::filesystem::path, path_vector_t> imageFilesByGroundTruthFile;
+    images_by_ground_truth_t imageFilesByGroundTruthFile;
 
     boost::filesystem::path outputFolder;
     boost::filesystem::path logfile;
+    // timestamped folder of this run, contains the log file and checkpoints
+    boost::filesystem::path checkpointFolder;
 
     boost::optional<boost::filesystem::path> preprocessorSettings;
     boost::optional<boost::filesystem::path> localizerSettings;
@@ -54,7 +74,7 @@ struct multiple_path_struct_t {
     boost::optional<boost::filesystem::path> gridFitterSettings;
 
     multiple_path_struct_t() {}
-    multiple_path_struct_t(std::map<boost::filesystem::path, path_vector_t> const& imageFilesByGroundTruthFile,
+    multiple_path_struct_t(images_by_ground_truth_t const& imageFilesByGroundTruthFile,
                   boost::filesystem::path const& outputFolder,
                   boost::filesystem::path const& logfile)
         : imageFilesByGroundTruthFile(imageFilesByGroundTruthFile)
@@ -63,6 +83,46 @@ struct multiple_path_struct_t {
     {}
 };
 
+size_t getDefaultNumThreads();
+
+struct ModelOptions {
+    // total number of worker threads used for evaluations
+    size_t num_threads;
+    // number of queries proposed per iteration, at most num_threads of them
+    // are evaluated concurrently
+    size_t batch_size;
+    // memory limit of the preprocessor cache of the localizer model (unit: MB)
+    size_t preprocessor_cache_size;
+    // evaluate queries on growing subsets of the images and abort as soon as
+    // they can not beat the best query so far
+    bool racing;
+    // width of the confidence interval of the mean score (in standard errors)
+    double racing_confidence;
+    // number of images evaluated before the first check
+    size_t racing_min_images;
+    // evaluate proposals on a subset of the images first and only evaluate
+    // promising ones on all images. the fidelity is an additional dimension
+    // of the query.
+    bool multi_fidelity;
+    // share of the images used by low fidelity evaluations
+    double low_fidelity_fraction;
+    // low fidelity scores at most this much worse than the best low fidelity
+    // score are evaluated again on all images
+    double multi_fidelity_threshold;
+
+    ModelOptions()
+        : num_threads(getDefaultNumThreads())
+        , batch_size(1)
+        , preprocessor_cache_size(2048)
+        , racing(false)
+        , racing_confidence(2.)
+        , racing_min_images(8)
+        , multi_fidelity(false)
+        , low_fidelity_fraction(0.25)
+        , multi_fidelity_threshold(0.02)
+    {}
+};
+
 struct OptimizationResult {
 	OptimizationResult(double fscore, double recall, double precision)
 	    : fscore(fscore)
@@ -100,6 +160,26 @@ struct limits_t {
 	}
 };
 
+/**
+ * compact json representation of the effective values of a pipeline settings
+ * object, settings with identical values have identical representations
+ */
+template <typename Settings>
+std::string getSettingsString(Settings settings) {
+	boost::property_tree::ptree pt;
+	settings.addToPTree(pt);
+
+	std::stringstream ss;
+	boost::property_tree::write_json(ss, pt, false);
+
+	return ss.str();
+}
+
+template <typename Settings>
+size_t getSettingsHash(Settings const& settings) {
+	return std::hash<std::string>()(getSettingsString(settings));
+}
+
 bool operator<(const OptimizationResult &a, const OptimizationResult &b);
 
 double getFScore(const double recall, const double precision, const double beta);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <pipeline/datastructure/Tag.h>
+#include <pipeline/util/GroundTruthEvaluator.h>
+
+#include "Common.h"
+#include "ImageStore.h"
+
+namespace opt {
+
+/**
+ * ground truth files and images of a task with dense integer ids. ground
+ * truth files are numbered in the order of the task, images in the order of
+ * their ground truth files and frames. frames whose image is missing have no
+ * image id, every image keeps the frame number it has in its ground truth
+ * file. the decoded images, the ground truth and the taglists of the pipeline
+ * stages that are fixed during an optimization are stored in arrays indexed
+ * by these ids.
+ *
+ * a dataset is built once per task and shared by all models. taglists have to
+ * be set before the models that use them are created.
+ */
+class Dataset {
+  public:
+    struct Image {
+        size_t groundTruthIdx;
+        // frame number within the ground truth file, i.e. the index of the
+        // image in its file names
+        size_t frameNumber;
+        boost::filesystem::path path;
+    };
+
+    // pipeline stages whose output is used as input of later models
+    enum class Stage {
+        Localizer,
+        EllipseFitter
+    };
+
+    typedef std::vector<pipeline::Tag> Taglist;
+    // immutable taglist of an image, shared by all workers
+    typedef std::shared_ptr<const Taglist> TaglistPtr;
+
+    // loads the ground truth files and decodes all images of the task
+    explicit Dataset(multiple_path_struct_t const& task);
+
+    size_t getNumImages() const { return _images.size(); }
+    size_t getNumGroundTruthFiles() const { return _groundTruth.size(); }
+
+    Image const& getImage(size_t imageIdx) const { return _images[imageIdx]; }
+    std::vector<Image> const& getImages() const { return _images; }
+
+    // decoded grayscale image
+    cv::Mat const& getImageData(size_t imageIdx) const { return *_imageData[imageIdx]; }
+
+    GroundTruthEvaluation::ResultsByFrame const& getGroundTruth(size_t groundTruthIdx) const {
+        return _groundTruth[groundTruthIdx];
+    }
+
+    bool hasTaglists(Stage stage) const { return !_taglists[getStageIdx(stage)].empty(); }
+
+    // taglist of an image, only valid if the taglists of the stage were set
+    Taglist const& getTaglist(Stage stage, size_t imageIdx) const {
+        return *_taglists[getStageIdx(stage)][imageIdx];
+    }
+
+    // taglists of all images (by image id) of a stage
+    void setTaglists(Stage stage, std::vector<Taglist> taglists);
+
+  private:
+    static constexpr size_t NUM_STAGES = 2;
+
+    static constexpr size_t getStageIdx(Stage stage) { return static_cast<size_t>(stage); }
+
+    std::vector<Image> _images;
+    std::vector<ImageStore::image_ptr_t> _imageData;
+    std::vector<GroundTruthEvaluation::ResultsByFrame> _groundTruth;
+    std::array<std::vector<TaglistPtr>, NUM_STAGES> _taglists;
+};
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Common.h"
+
+namespace opt {
+
+/**
+ * index of all ground truth files below a data root and the images they
+ * reference. the index is stored in the data root and updated incrementally:
+ * every directory is listed, but only ground truth files that changed are
+ * parsed again and the existing images are only matched again if the image
+ * files of their directory changed. images are matched with
+ * the listing of the folder of their ground truth file without accessing them
+ * individually, images in other folders are checked on every update. other
+ * files, e.g. the outputs of earlier runs, do not count as changes. all paths
+ * in the index are relative to the data root.
+ */
+class DatasetManifest {
+  public:
+    typedef multiple_path_struct_t::images_by_ground_truth_t ImageFilesByGroundTruthFile;
+
+    // sorted names of the entries of a directory that are part of the index
+    struct DirectoryEntry {
+        std::vector<std::string> subdirectories;
+        std::vector<std::string> groundTruthFiles;
+        std::vector<std::string> images;
+
+        bool operator==(DirectoryEntry const& other) const {
+            return subdirectories == other.subdirectories && groundTruthFiles == other.groundTruthFiles &&
+                   images == other.images;
+        }
+
+        template <class Archive>
+        void serialize(Archive& ar) {
+            ar(subdirectories, groundTruthFiles, images);
+        }
+    };
+
+    struct GroundTruthEntry {
+        std::time_t mtime;
+        // images referenced by the ground truth file, relative to its folder
+        std::vector<std::string> imageNames;
+        // referenced images that exist
+        std::vector<std::string> images;
+
+        template <class Archive>
+        void serialize(Archive& ar) {
+            ar(mtime, imageNames, images);
+        }
+    };
+
+    explicit DatasetManifest(boost::filesystem::path const& dataRoot);
+
+    // loads the stored manifest of the data root (if any), updates it and
+    // writes it back if anything changed
+    static DatasetManifest loadAndUpdate(boost::filesystem::path const& dataRoot);
+
+    static boost::filesystem::path getManifestPath(boost::filesystem::path const& dataRoot);
+
+    bool load();
+    void save() const;
+
+    // returns true if the manifest changed
+    bool update();
+
+    // absolute paths of all ground truth files and their existing images with
+    // their frame numbers
+    ImageFilesByGroundTruthFile getImageFilesByGroundTruthFile() const;
+
+  private:
+    // keeps the referenced images of the entry that are in the listing of its
+    // folder. images in other folders are checked individually.
+    static void resolveImages(boost::filesystem::path const& folder, DirectoryEntry const& directory,
+                              GroundTruthEntry& entry);
+
+    boost::filesystem::path _dataRoot;
+
+    std::map<std::string, DirectoryEntry> _directories;
+    std::map<std::string, GroundTruthEntry> _groundTruthFiles;
+};
+}
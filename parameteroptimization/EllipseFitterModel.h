@@ -33,22 +33,26 @@ struct EllipseFitterResult : OptimizationResult {
 
 class EllipseFitterModel : public OptimizationModel {
 public:
-    EllipseFitterModel(bopt_params param, multiple_path_struct_t const &task,
-                       TaglistByImage const &taglist,
+    EllipseFitterModel(bopt_params param, std::shared_ptr<const Dataset> const &dataset,
+                       ModelOptions const &options,
                        ParameterMaps const &limitsByParameter);
 
-    EllipseFitterModel(bopt_params param, const multiple_path_struct_t &task,
-                       TaglistByImage const &taglist);
+    EllipseFitterModel(bopt_params param, std::shared_ptr<const Dataset> const &dataset,
+                       ModelOptions const &options);
 
     virtual ParameterMaps getDefaultLimits() override;
 
 	void applyQueryToSettings(const boost::numeric::ublas::vector<double> &query,
-							  pipeline::settings::ellipsefitter_settings_t &settings);
+							  pipeline::settings::ellipsefitter_settings_t &settings) const;
 
 	boost::optional<EllipseFitterResult>
 	evaluate(pipeline::settings::ellipsefitter_settings_t &settings);
 
-	virtual double evaluateSample(const boost::numeric::ublas::vector<double> &query) override;
+	boost::optional<EllipseFitterResult>
+	evaluate(pipeline::settings::ellipsefitter_settings_t &settings, WorkerRange workers, ImageIndices const& imageIndices);
+
+	virtual double evaluateQuery(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+	                             Fidelity fidelity) override;
 
 	virtual bool checkReachability(const boost::numeric::ublas::vector<double> &query) override;
 
@@ -59,8 +63,23 @@ public:
 	}
 
   private:
+    // pipeline objects and evaluation state owned by a single worker thread
+    struct Worker {
+        std::unique_ptr<pipeline::EllipseFitter> ellipseFitter;
+        // evaluation state of the current image, restored from its snapshot
+        std::unique_ptr<GroundTruthEvaluation> evaluator;
+    };
+
+    void loadSettings(pipeline::settings::ellipsefitter_settings_t const &settings, WorkerRange workers);
+
+    std::vector<OptimizationResult> evaluateImages(WorkerRange workers, ImageIndices const& imageIndices);
+
+    std::vector<OptimizationResult> evaluateChunk(Worker &worker, StageTimes &stageTimes,
+                                                  ImageIndices const& imageIndices) const;
+
 	pipeline::settings::ellipsefitter_settings_t _settings;
-	pipeline::EllipseFitter _ellipseFitter;
-    TaglistByImage _taglistByImage;
+    std::vector<EvaluatorSnapshot> _evaluatorSnapshots;
+
+    std::vector<Worker> _workers;
 };
 }
@@ -38,6 +38,40 @@ public:
 
 	static_assert(POINTS_PER_RING % 4 == 0 , "POINTS_PER_RING = NUM_MIDDLE_CELLS * POINTS_PER_MIDDLE_CELL must be a multiple of 4");
 
+	// number of projected points of the mesh: the three rings followed by the inner line
+	static const size_t INDEX_MESH_LINE_BEGIN = 3 * POINTS_PER_RING;
+	static const size_t NUM_MESH_POINTS       = INDEX_MESH_LINE_BEGIN + POINTS_PER_LINE;
+
+	// number of points per polygon
+	static const size_t POINTS_OUTER_WHITE_RING       = POINTS_PER_RING + 1;
+	static const size_t POINTS_INNER_WHITE_SEMICIRCLE = POINTS_PER_RING / 2 + 1;
+	static const size_t POINTS_INNER_BLACK_SEMICIRCLE = POINTS_PER_RING / 2 + 1 + POINTS_PER_LINE;
+	static const size_t POINTS_PER_CELL_POLYGON       = POINTS_PER_MIDDLE_CELL + 2;
+
+	// offsets of the polygons in the point buffer (in polygon index order)
+	static const size_t OFFSET_OUTER_WHITE_RING       = 0;
+	static const size_t OFFSET_INNER_WHITE_SEMICIRCLE = OFFSET_OUTER_WHITE_RING + POINTS_OUTER_WHITE_RING;
+	static const size_t OFFSET_INNER_BLACK_SEMICIRCLE = OFFSET_INNER_WHITE_SEMICIRCLE + POINTS_INNER_WHITE_SEMICIRCLE;
+	static const size_t OFFSET_MIDDLE_CELLS_BEGIN     = OFFSET_INNER_BLACK_SEMICIRCLE + POINTS_INNER_BLACK_SEMICIRCLE;
+	static const size_t NUM_POLYGON_POINTS            = OFFSET_MIDDLE_CELLS_BEGIN + NUM_MIDDLE_CELLS * POINTS_PER_CELL_POLYGON;
+
+	// interaction points: the cell centers, the center of the grid and P1
+	static const size_t NUM_INTERACTION_POINTS = NUM_MIDDLE_CELLS + 2;
+
+	static constexpr size_t polygonSize(size_t index) {
+		return index == INDEX_OUTER_WHITE_RING       ? POINTS_OUTER_WHITE_RING :
+		       index == INDEX_INNER_WHITE_SEMICIRCLE ? POINTS_INNER_WHITE_SEMICIRCLE :
+		       index == INDEX_INNER_BLACK_SEMICIRCLE ? POINTS_INNER_BLACK_SEMICIRCLE :
+		                                               POINTS_PER_CELL_POLYGON;
+	}
+
+	static constexpr size_t polygonOffset(size_t index) {
+		return index == INDEX_OUTER_WHITE_RING       ? OFFSET_OUTER_WHITE_RING :
+		       index == INDEX_INNER_WHITE_SEMICIRCLE ? OFFSET_INNER_WHITE_SEMICIRCLE :
+		       index == INDEX_INNER_BLACK_SEMICIRCLE ? OFFSET_INNER_BLACK_SEMICIRCLE :
+		                                               OFFSET_MIDDLE_CELLS_BEGIN + (index - INDEX_MIDDLE_CELLS_BEGIN) * POINTS_PER_CELL_POLYGON;
+	}
+
 	static const double INNER_RING_RADIUS;
 	static const double MIDDLE_RING_RADIUS;
 	static const double OUTER_RING_RADIUS;
@@ -48,6 +82,51 @@ public:
 
 	typedef std::array<boost::tribool, NUM_MIDDLE_CELLS> idarray_t;
 
+	/**
+	 * parameters of many grids in structure-of-arrays form
+	 * (radius is the world radius, see getWorldRadius)
+	 */
+	struct parameters_soa_t
+	{
+		std::vector<double> radius;
+		std::vector<double> angle_z;
+		std::vector<double> angle_y;
+		std::vector<double> angle_x;
+
+		size_t size() const { return radius.size(); }
+	};
+
+	/**
+	 * read-only view of consecutive points, e.g. of one polygon
+	 */
+	class points_view_t
+	{
+	public:
+		points_view_t(const cv::Point *begin, size_t size) : _begin(begin), _size(size) {}
+
+		const cv::Point *begin() const { return _begin; }
+		const cv::Point *end() const { return _begin + _size; }
+		const cv::Point *data() const { return _begin; }
+		size_t size() const { return _size; }
+
+		const cv::Point &operator[](size_t i) const { return _begin[i]; }
+		const cv::Point &back() const { return _begin[_size - 1]; }
+
+	private:
+		const cv::Point *_begin;
+		size_t           _size;
+	};
+
+	/**
+	 * projected mesh points of many grids, point j of grid g is stored at
+	 * index j * numGrids + g
+	 */
+	struct points_soa_t
+	{
+		std::vector<int> x;
+		std::vector<int> y;
+	};
+
 	/******************************************
 	 *                                        *
 	 *            public function             *
@@ -59,11 +138,28 @@ public:
 	explicit Grid3D(cv::Point2i center, double radius, double angle_z, double angle_y, double angle_x);
 	virtual ~Grid3D() override;
 
+	/**
+	 * projects the meshes of all grids at once
+	 */
+	static void project(const parameters_soa_t &parameters, points_soa_t &points);
+
+	/**
+	 * recomputes the visualization data of all grids, equivalent to (but
+	 * faster than) calling it for every grid on its own
+	 */
+	static void prepareVisualizationData(std::vector<Grid3D*> const& grids);
+
 	/**
 	 * draws 2D projection of 3D-mesh on image
 	 */
 	void	draw(cv::Mat &img, const bool isActive) const;
 
+	/**
+	 * renders the tag with filled cells (colors according to the id) on a
+	 * grayscale image, e.g. to generate synthetic images
+	 */
+	void	render(cv::Mat &img) const;
+
 	void	setXRotation(double angle);
 	double	getXRotation() const { return _angle_x; }
 
@@ -113,10 +209,19 @@ public:
 	 * Axis-aligned minimum bounding box of the grid centered at (0, 0)
 	 */
 	cv::Rect getOriginBoundingBox() const {
+		ensure_visualization_data();
 		return _boundingBox;
 	}
 
-	std::vector<cv::Point> const& getOuterRingPoints() const { return _coordinates2D[OUTER_RING]; }
+	/**
+	 * points of a polygon (see INDEX_*) relative to the center of the grid
+	 */
+	points_view_t getPolygon(size_t index) const {
+		ensure_visualization_data();
+		return points_view_t(_polygonPoints.data() + polygonOffset(index), polygonSize(index));
+	}
+
+	points_view_t getOuterRingPoints() const { return getPolygon(INDEX_OUTER_WHITE_RING); }
 
 private:
 	/******************************************
@@ -168,9 +273,20 @@ private:
 
 	static coordinates3D_t generate_3D_base_coordinates();
 
-	coordinates2D_t        generate_3D_coordinates_from_parameters_and_project_to_2D();
-	void                   prepare_visualization_data();
+	static void            project_mesh(size_t numGrids, const double *rotation, const double *radius, int *x, int *y);
+
+	coordinates2D_t        generate_3D_coordinates_from_parameters_and_project_to_2D() const;
+	coordinates2D_t        generate_2D_coordinates(const int *x, const int *y, size_t stride) const;
+	void                   prepare_visualization_data() const;
+	void                   prepare_visualization_data(const coordinates2D_t &points_2d) const;
+
+	// the visualization data is computed on first use after a parameter changed
+	// (const access to the same grid from several threads is not safe)
+	void                   invalidate_visualization_data() { _visualizationDataValid = false; }
+	void                   ensure_visualization_data() const { if (!_visualizationDataValid) prepare_visualization_data(); }
+
 	void                   draw(cv::Mat &img, const cv::Point& center, const bool isActive) const;
+	void                   draw_polyline(cv::Mat &img, size_t index, const cv::Scalar &color, const cv::Point &offset) const;
 
 	/***************************************************************************
 	 * Parameter Section
@@ -183,19 +299,20 @@ private:
 	 *
 	 ***************************************************************************/
 
-	cv::Point2i                         _center;            // center point of the grid (within image borders - unit: px)
-	double                              _radius;            // radius of the tag (unit: px)
-	double                              _angle_z;           // the angle of the grid (unit: rad. points towards the head of the bee, positive is counter-clock)
-	double                              _angle_y;           // the rotation angle of the grid around y axis (rotates into z - space)
-	double                              _angle_x;           // the rotation angle of the grid around x axis (rotates into z - space)
-	idarray_t                           _ID;                // bit pattern of tag (false and true for black and white, indeterminate for unrecognizable)
-	std::vector<std::vector<cv::Point>> _coordinates2D;     // 2D coordinates of mesh (after perspective projection) (see opencv function drawContours)
-	std::vector<cv::Point>              _interactionPoints; // 2D coordinates of interaction points (center of grid, grid cell centers, etc)
-	static const coordinates3D_t        _coordinates3D;     // underlying 3D coordinates of grid mesh
-	float                               _transparency;      // weight in drawing mixture
-	boost::tribool                      _bitsTouched;       // if at least one bit was set, this is true, after copy & paste indeterminate
-	bool                                _isSettable;        // if tag can be recognized by a human
-	cv::Rect                            _boundingBox;       // bounding box of the projected 2d points
+	cv::Point2i                                           _center;                 // center point of the grid (within image borders - unit: px)
+	double                                                _radius;                 // radius of the tag (unit: px)
+	double                                                _angle_z;                // the angle of the grid (unit: rad. points towards the head of the bee, positive is counter-clock)
+	double                                                _angle_y;                // the rotation angle of the grid around y axis (rotates into z - space)
+	double                                                _angle_x;                // the rotation angle of the grid around x axis (rotates into z - space)
+	idarray_t                                             _ID;                     // bit pattern of tag (false and true for black and white, indeterminate for unrecognizable)
+	mutable std::array<cv::Point, NUM_POLYGON_POINTS>     _polygonPoints;          // 2D coordinates of the polygons of the mesh (after perspective projection) (see polygonOffset)
+	mutable std::array<cv::Point, NUM_INTERACTION_POINTS> _interactionPoints;      // 2D coordinates of interaction points (center of grid, grid cell centers, etc)
+	static const coordinates3D_t                          _coordinates3D;          // underlying 3D coordinates of grid mesh
+	float                                                 _transparency;           // weight in drawing mixture
+	boost::tribool                                        _bitsTouched;            // if at least one bit was set, this is true, after copy & paste indeterminate
+	bool                                                  _isSettable;             // if tag can be recognized by a human
+	mutable cv::Rect                                      _boundingBox;            // bounding box of the projected 2d points
+	mutable bool                                          _visualizationDataValid; // if _polygonPoints, _interactionPoints and _boundingBox match the parameters
 
 
 	// generate serialization functions
@@ -225,7 +342,7 @@ private:
 		   CEREAL_NVP(_bitsTouched),
 		   CEREAL_NVP(_isSettable));
 
-		prepare_visualization_data();
+		invalidate_visualization_data();
 	}
 };
 
@@ -35,31 +35,52 @@ struct GridfitterResult {
 
 class GridfitterModel : public OptimizationModel {
   public:
-    GridfitterModel(bopt_params param, multiple_path_struct_t const &task,
-                   TaglistByImage const &taglistEllipseFitter,
+    GridfitterModel(bopt_params param, std::shared_ptr<const Dataset> const &dataset,
+                   ModelOptions const &options,
                    ParameterMaps const &limitsByParameter);
 
-    GridfitterModel(bopt_params param, const multiple_path_struct_t &task,
-                   TaglistByImage const &taglistEllipseFitter);
+    GridfitterModel(bopt_params param, std::shared_ptr<const Dataset> const &dataset,
+                   ModelOptions const &options);
 
     virtual ParameterMaps getDefaultLimits() override;
 
 	void applyQueryToSettings(const boost::numeric::ublas::vector<double> &query,
-							  pipeline::settings::gridfitter_settings_t &settings);
+							  pipeline::settings::gridfitter_settings_t &settings) const;
 
 	boost::optional<GridfitterResult>
 	evaluate(pipeline::settings::gridfitter_settings_t &settings);
 
-	virtual double evaluateSample(const boost::numeric::ublas::vector<double> &query) override;
+	boost::optional<GridfitterResult>
+	evaluate(pipeline::settings::gridfitter_settings_t &settings, WorkerRange workers, ImageIndices const& imageIndices);
+
+	virtual double evaluateQuery(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+	                             Fidelity fidelity) override;
 	virtual bool checkReachability(const boost::numeric::ublas::vector<double> &query) override;
 
     static size_t getNumDimensions() { return 13; }
 
   private:
+    // pipeline objects and evaluation state owned by a single worker thread
+    struct Worker {
+        std::unique_ptr<pipeline::GridFitter> gridfitter;
+        std::unique_ptr<pipeline::Decoder> decoder;
+        // evaluation state of the current image, restored from its snapshot
+        std::unique_ptr<GroundTruthEvaluation> evaluator;
+    };
+
+    void loadSettings(pipeline::settings::gridfitter_settings_t const &settings, WorkerRange workers);
+
+    std::vector<GridfitterResult> evaluateImages(WorkerRange workers, pipeline::settings::gridfitter_settings_t const &settings,
+                                                 ImageIndices const& imageIndices);
+
+    std::vector<GridfitterResult> evaluateChunk(Worker &worker, StageTimes &stageTimes,
+                                                pipeline::settings::gridfitter_settings_t const &settings,
+                                                ImageIndices const& imageIndices) const;
+
 	pipeline::settings::gridfitter_settings_t _settings;
-	pipeline::GridFitter _gridfitter;
-    pipeline::Decoder _decoder;
 
-    TaglistByImage _taglistEllipseFitter;
+    std::vector<EvaluatorSnapshot> _evaluatorSnapshots;
+
+    std::vector<Worker> _workers;
 };
 }
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include <biotracker/serialization/SerializationData.h>
+
+#include <pipeline/util/GroundTruthEvaluator.h>
+
+namespace opt {
+
+// path of the binary ground truth file belonging to a .tdat file
+boost::filesystem::path getBinaryGroundTruthPath(boost::filesystem::path const& groundTruthPath);
+
+/**
+ * loads a .tdat ground truth file. if a binary ground truth file exists
+ * that is at least as recent as the .tdat file, it is loaded instead of
+ * parsing the JSON data.
+ */
+BioTracker::Core::Serialization::Data loadGroundTruth(boost::filesystem::path const& groundTruthPath);
+
+BioTracker::Core::Serialization::Data loadJsonGroundTruth(boost::filesystem::path const& groundTruthPath);
+BioTracker::Core::Serialization::Data loadBinaryGroundTruth(boost::filesystem::path const& binaryPath);
+
+/**
+ * converts the grids of all tracked objects into the ground truth of the
+ * first numFrames frames (the frames named by the file). every one of these
+ * frames gets an entry, even if it has no grids, later frames get none.
+ */
+GroundTruthEvaluation::ResultsByFrame getResultsByFrame(BioTracker::Core::Serialization::Data const& data,
+                                                        size_t numFrames);
+
+void writeJsonGroundTruth(BioTracker::Core::Serialization::Data const& data,
+                          boost::filesystem::path const& groundTruthPath);
+
+void writeBinaryGroundTruth(BioTracker::Core::Serialization::Data const& data,
+                            boost::filesystem::path const& binaryPath);
+}
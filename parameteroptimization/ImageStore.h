@@ -0,0 +1,50 @@
+#pragma once
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core/core.hpp>
+
+namespace opt {
+
+/**
+ * process-wide store of decoded grayscale images. an image is decoded on the
+ * first request and shared with all later requests for as long as at least
+ * one reference to it exists. images are decoded without holding the lock of
+ * the store, concurrent requests for an image that is being decoded wait for
+ * that decode. if decoding throws, all of them get the exception and the next
+ * request decodes the image again.
+ */
+class ImageStore {
+  public:
+    typedef std::shared_ptr<const cv::Mat> image_ptr_t;
+
+    static ImageStore& getInstance();
+
+    image_ptr_t get(boost::filesystem::path const& imagePath);
+
+    // number of images decoded since the start of the process
+    size_t getNumDecoded() const;
+
+  private:
+    struct Entry {
+        std::weak_ptr<const cv::Mat> image;
+        // valid while the image is being decoded
+        std::shared_future<image_ptr_t> pending;
+    };
+
+    ImageStore();
+
+    // removes the entries of images that are neither referenced nor being
+    // decoded, has to be called with the lock held
+    void removeExpired();
+
+    mutable std::mutex _mutex;
+    std::map<boost::filesystem::path, Entry> _imageByPath;
+    size_t _numDecoded;
+};
+}
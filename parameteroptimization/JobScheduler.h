@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace opt {
+
+/**
+ * runs independent jobs, e.g. the optimization of several data folders, on a
+ * fixed number of threads. jobs are started in the order they were added,
+ * every start and end is reported together with the overall progress.
+ */
+class JobScheduler {
+  public:
+    struct Job {
+        std::string name;
+        std::function<void()> run;
+    };
+
+    explicit JobScheduler(size_t numConcurrentJobs);
+
+    void addJob(std::string const& name, std::function<void()> run);
+
+    size_t getNumJobs() const { return _jobs.size(); }
+
+    // runs all jobs and returns the number of failed jobs, i.e. of jobs
+    // that threw anything
+    size_t run();
+
+  private:
+    void runJob(size_t jobIdx);
+
+    const size_t _numConcurrentJobs;
+    std::vector<Job> _jobs;
+
+    // guards the counters and the progress output
+    std::mutex _mutex;
+    size_t _numRunning;
+    size_t _numFinished;
+    size_t _numFailed;
+};
+}
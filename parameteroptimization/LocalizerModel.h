@@ -2,6 +2,7 @@
 
 #include "Common.h"
 #include "OptimizationModel.h"
+#include "PreprocessorCache.h"
 
 #include <pipeline/settings/LocalizerSettings.h>
 #include <pipeline/Preprocessor.h>
@@ -40,24 +41,32 @@ struct LocalizerResult : OptimizationResult {
 
 class LocalizerModel : public OptimizationModel {
   public:
-    LocalizerModel(bopt_params param, multiple_path_struct_t const &task,
+    LocalizerModel(bopt_params param, std::shared_ptr<const Dataset> const &dataset,
+                   ModelOptions const &options,
                    boost::optional<DeepLocalizerPaths> const &deeplocalizerPaths,
                    ParameterMaps const &limitsByParameter);
 
-    LocalizerModel(bopt_params param, const multiple_path_struct_t &task,
+    LocalizerModel(bopt_params param, std::shared_ptr<const Dataset> const &dataset,
+                   ModelOptions const &options,
                    boost::optional<DeepLocalizerPaths> const &deeplocalizerPaths);
 
     virtual ParameterMaps getDefaultLimits() override;
 
 	void applyQueryToSettings(const boost::numeric::ublas::vector<double> &query,
 	                          pipeline::settings::localizer_settings_t &lsettings,
-	                          pipeline::settings::preprocessor_settings_t &psettings);
+	                          pipeline::settings::preprocessor_settings_t &psettings) const;
 
 	boost::optional<LocalizerResult>
 	evaluate(pipeline::settings::localizer_settings_t &lsettings,
 	         pipeline::settings::preprocessor_settings_t &psettings);
 
-	virtual double evaluateSample(const boost::numeric::ublas::vector<double> &query) override;
+	boost::optional<LocalizerResult>
+	evaluate(pipeline::settings::localizer_settings_t &lsettings,
+	         pipeline::settings::preprocessor_settings_t &psettings,
+	         WorkerRange workers, ImageIndices const& imageIndices);
+
+	virtual double evaluateQuery(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+	                             Fidelity fidelity) override;
 	virtual bool checkReachability(const boost::numeric::ublas::vector<double> &query) override;
 
     static size_t getNumDimensions();
@@ -69,11 +78,33 @@ class LocalizerModel : public OptimizationModel {
 		return _localizerSettings;
 	}
 
+	PreprocessorCache const& getPreprocessorCache() const {
+		return _preprocessorCache;
+	}
+
   private:
+    // pipeline objects and evaluation state owned by a single worker thread
+    struct Worker {
+        std::unique_ptr<pipeline::Preprocessor> preprocessor;
+        std::unique_ptr<pipeline::Localizer> localizer;
+        std::vector<std::unique_ptr<GroundTruthEvaluation>> evaluators;
+    };
+
+    void loadSettings(pipeline::settings::localizer_settings_t const &lsettings,
+                      pipeline::settings::preprocessor_settings_t const &psettings,
+                      WorkerRange workers);
+
+    std::vector<OptimizationResult> evaluateImages(WorkerRange workers, size_t preprocessorSettingsHash,
+                                                   ImageIndices const& imageIndices);
+
+    std::vector<OptimizationResult> evaluateChunk(Worker &worker, StageTimes &stageTimes, size_t preprocessorSettingsHash,
+                                                  ImageIndices const& imageIndices);
+
     pipeline::settings::preprocessor_settings_t _preprocessorSettings;
     pipeline::settings::localizer_settings_t _localizerSettings;
 
-    std::unique_ptr<pipeline::Preprocessor> _preprocessor;
-    std::unique_ptr<pipeline::Localizer> _localizer;
+    std::vector<Worker> _workers;
+
+    PreprocessorCache _preprocessorCache;
 };
 }
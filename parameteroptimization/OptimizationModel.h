@@ -1,9 +1,19 @@
 #pragma once
 
 #include "Common.h"
+#include "Dataset.h"
+#include "ScoreCache.h"
+#include "Telemetry.h"
+
+#include <cmath>
+#include <future>
+#include <limits>
+#include <mutex>
 
 #include <bayesopt.hpp>
 
+#include <pipeline/util/ThreadPool.h>
+
 namespace opt {
 
 double getMeanFscore(std::vector<OptimizationResult> const& results);
@@ -18,43 +28,394 @@ class OptimizationModel : public bayesopt::ContinuousModel {
 
         limitsByParam limitsByParameter;
         queryIdxByParam queryIdxByParameter;
+
+        // number of parameters with min != max
+        size_t getNumFreeParameters() const;
+
+        /**
+         * removes all parameters with min == max from the query, i.e. from
+         * queryIdxByParameter, and renumbers the remaining parameters in their
+         * original order. the removed parameters stay in limitsByParameter.
+         */
+        void pinConstantParameters();
+
+        // normalized value of a parameter, pinned parameters are always 0
+        double getQueryValue(std::string const& param, const boost::numeric::ublas::vector<double>& query) const;
     };
 
-    typedef std::map<boost::filesystem::path, std::vector<pipeline::Tag>> TaglistByImage;
+    // contiguous range of worker indices used for a single evaluation
+    struct WorkerRange {
+        size_t first;
+        size_t count;
+    };
 
-    OptimizationModel(bopt_params param, multiple_path_struct_t const &task,
-                      ParameterMaps const &limitsByParameter, size_t numDimensions);
+    // immutable evaluation state of an image, shared by all workers
+    typedef std::shared_ptr<const GroundTruthEvaluation> EvaluatorSnapshot;
+
+    // image ids of the dataset
+    typedef std::vector<size_t> ImageIndices;
+
+    // low fidelity evaluations only use a fixed subset of the images
+    enum class Fidelity {
+        Low,
+        Full
+    };
+
+    OptimizationModel(bopt_params param, std::shared_ptr<const Dataset> const &dataset,
+                      ModelOptions const &options,
+                      ParameterMaps const &limitsByParameter);
 
     virtual ParameterMaps getDefaultLimits() = 0;
 
-    void addLimitToParameter(std::string const& param, limits_t limits,
-                             ParameterMaps &parameterMaps);
+    // adds a parameter with the next free query index, parameters that are
+    // already part of the maps keep their limits and index
+    static void addLimitToParameter(std::string const& param, limits_t limits,
+                                    ParameterMaps &parameterMaps);
 
     template <typename ParamType, typename Settings>
-    void setValueFromQuery(Settings &settings, std::string const &paramName, const boost::numeric::ublas::vector<double>& query) {
-        settings.template setValue<ParamType>(
-            paramName, _parameterMaps.limitsByParameter[paramName].getVal<ParamType>(
-                        query[_parameterMaps.queryIdxByParameter[paramName]]));
+    void setValueFromQuery(Settings &settings, std::string const &paramName, const boost::numeric::ublas::vector<double>& query) const {
+        setValueFromQuery<ParamType>(settings, paramName, _parameterMaps.getQueryValue(paramName, query));
     }
 
     template <typename ParamType, typename Settings>
-	void setValueFromQuery(Settings &settings, std::string const &paramName, double value) {
+    void setOddValueFromQuery(Settings &settings, std::string const &paramName, const boost::numeric::ublas::vector<double>& query) const {
+        setOddValueFromQuery<ParamType>(settings, paramName, _parameterMaps.getQueryValue(paramName, query));
+    }
+
+    template <typename ParamType, typename Settings>
+	void setValueFromQuery(Settings &settings, std::string const &paramName, double value) const {
         settings.template setValue<ParamType>(
-            paramName, _parameterMaps.limitsByParameter[paramName].getVal<ParamType>(value));
+            paramName, _parameterMaps.limitsByParameter.at(paramName).getVal<ParamType>(value));
 	}
 
 	template <typename ParamType, typename Settings>
-	void setOddValueFromQuery(Settings &settings, std::string const &paramName, double value) {
+	void setOddValueFromQuery(Settings &settings, std::string const &paramName, double value) const {
         settings.template setValue<ParamType>(
-            paramName, _parameterMaps.limitsByParameter[paramName].getNearestOddVal<ParamType>(value));
+            paramName, _parameterMaps.limitsByParameter.at(paramName).getNearestOddVal<ParamType>(value));
 	}
 
-	virtual double evaluateSample(const boost::numeric::ublas::vector<double> &query) override = 0;
+    /**
+     * the state of the optimization is written to checkpointPath after the
+     * initial design and after every iteration. if the file already exists,
+     * the optimization is resumed from it without evaluating the stored
+     * samples again.
+     */
+    void setCheckpointPath(boost::filesystem::path const& checkpointPath);
+
+    /**
+     * runs the bayesian optimization. the initial design is evaluated
+     * concurrently, one query per worker. with a batch size > 1, each iteration
+     * proposes batch_size queries using the constant liar heuristic and
+     * evaluates them concurrently, each on its own subset of the workers. if
+     * there are more queries than workers, queries wait for a free worker.
+     */
+    void optimizeInBatches(boost::numeric::ublas::vector<double> &bestPoint);
+
+    // evaluates the queries concurrently and returns their scores in the same
+    // order. the workers are split into at most one range per query, queries
+    // are assigned to the next free range.
+    std::vector<double> evaluateQueries(std::vector<boost::numeric::ublas::vector<double>> const& queries);
+
+    // called by BayesOpt, either records a proposed query of the current
+    // batch or evaluates it using all workers
+    virtual double evaluateSample(const boost::numeric::ublas::vector<double> &query) override final;
+
+    // evaluates a query on the images of the given fidelity using the workers
+    // in the given range, has to be safe to call concurrently for disjoint
+    // worker ranges
+    virtual double evaluateQuery(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+                                 Fidelity fidelity) = 0;
+
 	virtual bool checkReachability(const boost::numeric::ublas::vector<double> &query) override = 0;
 
+    // number of dimensions of the query, i.e. of the non-constant parameters
+    // and the fidelity in multi fidelity mode
+    size_t getNumQueryDimensions() const { return mDims; }
+
+    // the fidelity is the last dimension of the query, 0 is low and 1 is full
+    Fidelity getFidelity(const boost::numeric::ublas::vector<double> &query) const;
+
+    ScoreCache const& getScoreCache() const { return _scoreCache; }
+
+    // every evaluation of a query is written to the sink
+    void setTelemetrySink(std::shared_ptr<TelemetrySink> const& telemetrySink);
+
+    size_t getNumWorkers() const { return _numWorkers; }
+    WorkerRange getAllWorkers() const { return {0, _numWorkers}; }
+
   protected:
-    std::map<boost::filesystem::path, cv::Mat> _imageByPath;
-    std::map<std::unique_ptr<GroundTruthEvaluation>, std::vector<boost::filesystem::path>> _imagesByEvaluator;
+    // creates one GroundTruthEvaluation per ground truth file, used to give
+    // every worker thread its own evaluation state
+    std::vector<std::unique_ptr<GroundTruthEvaluation>> createEvaluators() const;
+
+    // evaluation state of every image (by image id) after its taglist of the
+    // given stage was matched with its ground truth as localizer results.
+    // computed once on all workers, every evaluation of an image starts from a
+    // copy of its snapshot. the snapshots refer to the taglists of the
+    // dataset, which must not be replaced while the model exists.
+    std::vector<EvaluatorSnapshot> createEvaluatorSnapshots(Dataset::Stage stage);
+
+    // copies the snapshot into the evaluator of a worker, reusing its storage
+    static void restoreEvaluator(std::unique_ptr<GroundTruthEvaluation>& evaluator, GroundTruthEvaluation const& snapshot) {
+        if (evaluator) {
+            *evaluator = snapshot;
+        } else {
+            evaluator = std::make_unique<GroundTruthEvaluation>(snapshot);
+        }
+    }
+
+    // all images of the dataset in their original order
+    ImageIndices const& getAllImages() const { return _allImages; }
+
+    // images evaluated by a query of the given fidelity
+    ImageIndices const& getImages(Fidelity fidelity) const {
+        return fidelity == Fidelity::Full ? _allImages : _lowFidelityImages;
+    }
+
+    // suffix of the score cache key, scores of both fidelities are cached
+    static std::string getFidelityKey(Fidelity fidelity) {
+        return fidelity == Fidelity::Full ? "" : "#low";
+    }
+
+    // splits the images into one contiguous chunk per worker, runs
+    // evaluateChunk(workerIdx, chunkIndices) on the thread pool and returns
+    // the per-image results in the same order as imageIndices
+    template <typename Result, typename Function>
+    std::vector<Result> evaluateInParallel(WorkerRange workers, ImageIndices const& imageIndices,
+                                           Function evaluateChunk)
+    {
+        const size_t numImages  = imageIndices.size();
+        const size_t numWorkers = std::max<size_t>(1, std::min(workers.count, numImages));
+
+        std::vector<std::future<std::vector<Result>>> futures;
+        for (size_t chunkIdx = 0; chunkIdx < numWorkers; ++chunkIdx) {
+            const size_t beginIdx = (chunkIdx * numImages) / numWorkers;
+            const size_t endIdx   = ((chunkIdx + 1) * numImages) / numWorkers;
+
+            ImageIndices chunkIndices(imageIndices.begin() + beginIdx, imageIndices.begin() + endIdx);
+
+            futures.push_back(_threadPool->enqueue(evaluateChunk, workers.first + chunkIdx, std::move(chunkIndices)));
+        }
+
+        std::vector<Result> results;
+        results.reserve(numImages);
+        for (auto& future : futures) {
+            for (Result const& result : future.get()) {
+                results.push_back(result);
+            }
+        }
+
+        return results;
+    }
+
+    /**
+     * evaluates the images of the given fidelity in a fixed, shuffled order in
+     * rounds of at least racing_min_images images. evaluateImages(imageIndices)
+     * returns the per-image results, getCost(result) the cost of a single
+     * image (lower is better). after every round the lower confidence bound of
+     * the mean cost is compared with the best fully evaluated query so far. if
+     * it is worse, the evaluation is aborted and the upper confidence bound is
+     * returned as a pessimistic cost and aborted is set. otherwise the mean
+     * cost of all images is returned.
+     */
+    template <typename Result, typename EvaluateImages, typename GetCost>
+    double race(WorkerRange workers, Fidelity fidelity, EvaluateImages evaluateImages, GetCost getCost,
+                std::vector<std::pair<size_t, double>>& imageCosts, bool& aborted)
+    {
+        aborted = false;
+
+        const ImageIndices& racingOrder = fidelity == Fidelity::Full ? _racingOrder : _lowFidelityImages;
+        const size_t numImages = racingOrder.size();
+        const double bestCost  = getBestCost();
+        // nothing to race against yet, evaluate everything at once
+        const size_t roundSize = std::isinf(bestCost) ? numImages
+                                                      : std::max(_options.racing_min_images, workers.count);
+
+        double sum = 0.;
+        double sumOfSquares = 0.;
+        size_t numEvaluated = 0;
+
+        while (numEvaluated < numImages) {
+            const size_t endIdx = std::min(numImages, numEvaluated + roundSize);
+            const ImageIndices round(racingOrder.begin() + numEvaluated, racingOrder.begin() + endIdx);
+
+            const std::vector<Result> results = evaluateImages(round);
+            for (size_t i = 0; i < results.size(); ++i) {
+                const double cost = getCost(results[i]);
+                sum += cost;
+                sumOfSquares += cost * cost;
+
+                imageCosts.emplace_back(round[i], cost);
+            }
+            numEvaluated = endIdx;
+
+            if (numEvaluated == numImages) break;
+
+            const double n = static_cast<double>(numEvaluated);
+            const double mean = sum / n;
+            const double variance = std::max(0., (sumOfSquares - n * mean * mean) / std::max(1., n - 1.));
+            // finite population correction, the bound is exact after a full
+            // pass over the raced images
+            const double numRacedImages = static_cast<double>(numImages);
+            const double correction = (numRacedImages - n) / std::max(1., numRacedImages - 1.);
+            const double halfWidth = _options.racing_confidence * std::sqrt(variance / n * correction);
+
+            if (mean - halfWidth > bestCost) {
+                aborted = true;
+                return mean + halfWidth;
+            }
+        }
+
+        const double meanCost = sum / std::max<size_t>(1, numImages);
+        if (fidelity == Fidelity::Full) {
+            updateBestCost(meanCost);
+        }
+
+        return meanCost;
+    }
+
+    /**
+     * common part of evaluateQuery of all models. returns the cached cost if
+     * the settings the query is mapped to were already evaluated on this
+     * fidelity. otherwise loadSettings() loads the settings into the workers
+     * and the images of the fidelity are evaluated by evaluateImages
+     * (racing them if enabled). the cost of a query is the mean of the
+     * per-image costs getCost(result). every evaluation is recorded, only
+     * completed ones are cached: the cost of an aborted race is a bound that
+     * must not be reused.
+     */
+    template <typename Result, typename LoadSettings, typename EvaluateImages, typename GetCost>
+    double evaluateSettings(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+                            Fidelity fidelity, std::string const& settings, LoadSettings loadSettings,
+                            EvaluateImages evaluateImages, GetCost getCost)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        EvaluationRecord record;
+        record.settings = settings;
+
+        const std::string settingsKey = record.settings + getFidelityKey(fidelity);
+        if (const boost::optional<double> cachedScore = _scoreCache.get(settingsKey)) {
+            record.cached = true;
+            record.cost = cachedScore.get();
+            recordEvaluation(query, fidelity, record);
+
+            return cachedScore.get();
+        }
+
+        takeStageTimes(workers);
+
+        loadSettings();
+
+        bool aborted = false;
+        if (_options.racing) {
+            record.cost = race<Result>(workers, fidelity, evaluateImages, getCost, record.imageCosts, aborted);
+        } else {
+            const ImageIndices& imageIndices = getImages(fidelity);
+            const std::vector<Result> results = evaluateImages(imageIndices);
+
+            record.imageCosts = getImageCosts(imageIndices, results, getCost);
+
+            double sum = 0.;
+            for (auto const& imageCost : record.imageCosts) {
+                sum += imageCost.second;
+            }
+            record.cost = sum / std::max<size_t>(1, record.imageCosts.size());
+        }
+
+        if (!aborted) {
+            _scoreCache.insert(settingsKey, record.cost);
+        }
+
+        record.stageTimes = takeStageTimes(workers);
+        record.duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        recordEvaluation(query, fidelity, record);
+
+        return record.cost;
+    }
+
+    double getBestCost();
+    void updateBestCost(double cost);
+
+    // (image index, cost) pairs of the results of a full evaluation
+    template <typename Result, typename GetCost>
+    static std::vector<std::pair<size_t, double>> getImageCosts(ImageIndices const& imageIndices,
+                                                                std::vector<Result> const& results,
+                                                                GetCost getCost)
+    {
+        std::vector<std::pair<size_t, double>> imageCosts;
+        for (size_t i = 0; i < results.size(); ++i) {
+            imageCosts.emplace_back(imageIndices[i], getCost(results[i]));
+        }
+        return imageCosts;
+    }
+
+    // stage times measured by a worker since the last call of takeStageTimes
+    StageTimes& getStageTimes(size_t workerIdx) { return _stageTimesByWorker[workerIdx]; }
+    // sum of the stage times of the workers in the range, resets them
+    StageTimes takeStageTimes(WorkerRange workers);
+
+    // writes the record to the telemetry sink and updates the progress line,
+    // query and fidelity are set by this method
+    void recordEvaluation(const boost::numeric::ublas::vector<double> &query, Fidelity fidelity,
+                          EvaluationRecord& record);
+
+    std::shared_ptr<const Dataset> _dataset;
     ParameterMaps _parameterMaps;
+
+    ModelOptions _options;
+
+    ScoreCache _scoreCache;
+
+  private:
+    // generates the initial design up front, evaluates it concurrently and
+    // fits the surrogate to all samples at once
+    void initializeInParallel();
+
+    bool restoreCheckpoint();
+    void saveCheckpoint();
+
+    void stepBatch(size_t batchSize);
+
+    // evaluates the queries on low fidelity and evaluates the ones close to
+    // the best low fidelity score again on full fidelity. returns all
+    // evaluated queries and their scores.
+    std::pair<std::vector<boost::numeric::ublas::vector<double>>, std::vector<double>>
+    evaluateMultiFidelity(std::vector<boost::numeric::ublas::vector<double>> queries, double bestLowFidelityScore);
+
+    // best query evaluated on full fidelity
+    boost::numeric::ublas::vector<double> getBestFullFidelityResult();
+
+    boost::optional<boost::filesystem::path> _checkpointPath;
+
+    ImageIndices _allImages;
+    // evaluation order of the racing mode, shuffled once with a fixed seed
+    ImageIndices _racingOrder;
+    // prefix of the racing order
+    ImageIndices _lowFidelityImages;
+
+    // lowest cost of a fully evaluated query
+    std::mutex _bestCostMutex;
+    double _bestCost;
+
+    std::vector<StageTimes> _stageTimesByWorker;
+
+    std::shared_ptr<TelemetrySink> _telemetrySink;
+
+    // state of the progress line
+    std::mutex _progressMutex;
+    size_t _numEvaluations;
+    size_t _numCachedEvaluations;
+    double _bestReportedCost;
+    std::chrono::steady_clock::time_point _startTime;
+    std::chrono::steady_clock::time_point _lastProgressTime;
+
+    const size_t _numWorkers;
+    std::unique_ptr<ThreadPool> _threadPool;
+
+    // queries proposed by BayesOpt for the current batch
+    bool _collectingBatch;
+    std::vector<boost::numeric::ublas::vector<double>> _batchQueries;
+    double _batchLie;
 };
 }
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include <pipeline/Preprocessor.h>
+
+namespace opt {
+
+/**
+ * caches preprocessor results by image id and preprocessor settings hash.
+ *
+ * cached results share their image data with all users, i.e. the stages
+ * after the preprocessor must not modify the images in place. once the
+ * memory limit is reached, entries of other settings are evicted; if all
+ * entries belong to the current settings, new results are not cached.
+ */
+class PreprocessorCache {
+  public:
+    explicit PreprocessorCache(size_t maxBytes);
+
+    // returns the cached result for the given key or computes and caches it
+    pipeline::PreprocessorResult get(size_t imageId, size_t settingsHash,
+                                     std::function<pipeline::PreprocessorResult()> const& preprocess);
+
+    size_t getNumHits() const { return _numHits; }
+    size_t getNumMisses() const { return _numMisses; }
+    size_t getNumBytes() const;
+
+    void print() const;
+
+  private:
+    typedef std::pair<size_t, size_t> key_t;
+
+    struct Entry {
+        pipeline::PreprocessorResult result;
+        size_t numBytes;
+    };
+
+    const size_t _maxBytes;
+    size_t _numBytes;
+
+    std::atomic<size_t> _numHits;
+    std::atomic<size_t> _numMisses;
+
+    mutable std::mutex _mutex;
+    std::map<key_t, Entry> _entries;
+};
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <boost/optional.hpp>
+
+namespace opt {
+
+/**
+ * caches the scores of evaluated settings. many queries are mapped to the
+ * same settings after rounding, these only have to be evaluated once.
+ */
+class ScoreCache {
+  public:
+    ScoreCache();
+
+    // key is the concatenation of the settings strings of all stages that are evaluated
+    boost::optional<double> get(std::string const& key);
+    void insert(std::string const& key, double score);
+
+    size_t getNumHits() const { return _numHits; }
+    size_t getNumMisses() const { return _numMisses; }
+
+    void print() const;
+
+  private:
+    std::atomic<size_t> _numHits;
+    std::atomic<size_t> _numMisses;
+
+    std::mutex _mutex;
+    std::map<std::string, double> _scoreBySettings;
+};
+}
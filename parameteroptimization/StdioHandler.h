@@ -1,21 +1,31 @@
 #pragma once
 
-#include <cstdio>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <cstring>
-#include <csignal>
 #include <functional>
+#include <string>
+#include <thread>
 
-/* adapted from http://stackoverflow.com/a/25087408 */
+/**
+ * redirects stdout or stderr of the process into a pipe and calls the callback
+ * for every line written to it. the lines are read by a thread of the same
+ * process, so the callback must not write to the captured stream itself.
+ * the destructor restores the stream and returns after the callback has been
+ * called for all output, including an unterminated last line.
+ *
+ * the callback is called when a line is read from the pipe, not when it is
+ * written. under load the two can be far apart, so the time of the callback
+ * is not the time the line was printed.
+ */
 class StdioHandler
 {
 private:
-	pid_t pid = 0;
 	int origfd;
 	int streamid;
 	int pipefd[2];
+	std::thread reader;
+	std::function<void(const char*)> callback;
+
+	void readLines();
 public:
 	enum class Stream
 	{
@@ -24,6 +34,9 @@ public:
 	};
 	StdioHandler(Stream stream, std::function<void(const char*)> callback);
 	~StdioHandler();
+
+	StdioHandler(StdioHandler const&) = delete;
+	StdioHandler& operator=(StdioHandler const&) = delete;
 };
 
 class StdOutHandler : public StdioHandler
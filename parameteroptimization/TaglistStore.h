@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "Common.h"
+#include "Dataset.h"
+
+#include <pipeline/EllipseFitter.h>
+#include <pipeline/Localizer.h>
+#include <pipeline/Preprocessor.h>
+
+namespace opt {
+
+/**
+ * file in which the taglists of a stage are stored. the name contains a
+ * 64 bit FNV-1a hash of the settings of all stages up to and including this
+ * one. the hash does not depend on the standard library, so stored taglists
+ * stay valid across toolchain updates.
+ */
+boost::filesystem::path getTaglistPath(boost::filesystem::path const& folder,
+                                       std::string const& stage,
+                                       std::string const& upstreamSettings);
+
+/**
+ * loads stored taglists by image id. returns none if the file does not exist,
+ * can not be read, was generated with other settings (i.e. the hashes in the
+ * file names collided) or does not contain a taglist for every image of the
+ * dataset.
+ */
+boost::optional<std::vector<Dataset::Taglist>> loadTaglists(boost::filesystem::path const& taglistPath,
+                                                            std::string const& upstreamSettings,
+                                                            Dataset const& dataset);
+
+// stores the settings and the taglists of a stage of the dataset by the paths
+// of their images
+void saveTaglists(Dataset const& dataset, Dataset::Stage stage, std::string const& upstreamSettings,
+                  boost::filesystem::path const& taglistPath);
+
+// runs the preprocessor and the localizer on all images of the dataset
+std::vector<Dataset::Taglist> computeLocalizerTaglists(Dataset const& dataset,
+                                                       pipeline::settings::preprocessor_settings_t const& psettings,
+                                                       pipeline::settings::localizer_settings_t const& lsettings);
+
+// runs the pipeline up to the ellipse fitter on all images of the dataset,
+// tags without ellipse candidates are removed
+std::vector<Dataset::Taglist> computeEllipseFitterTaglists(Dataset const& dataset,
+                                                           pipeline::settings::preprocessor_settings_t const& psettings,
+                                                           pipeline::settings::localizer_settings_t const& lsettings,
+                                                           pipeline::settings::ellipsefitter_settings_t const& esettings);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+namespace opt {
+
+// accumulated wall time per pipeline stage and wall time of every single
+// image (unit: ms)
+struct StageTimes {
+    std::map<std::string, double> milliseconds;
+    std::vector<double> imageMilliseconds;
+
+    void add(std::string const& stage, std::chrono::steady_clock::time_point start);
+    void addImage(std::chrono::steady_clock::time_point start);
+    void merge(StageTimes const& other);
+};
+
+// everything known about a single evaluation of a query
+struct EvaluationRecord {
+    std::vector<double> query;
+    std::string fidelity;
+    // compact JSON of the settings the query is mapped to
+    std::string settings;
+    bool cached;
+    // (image index, cost) of all evaluated images, in evaluation order
+    std::vector<std::pair<size_t, double>> imageCosts;
+    StageTimes stageTimes;
+    // wall time of the whole evaluation (unit: ms)
+    double duration;
+    // cost reported to the optimizer
+    double cost;
+
+    EvaluationRecord()
+        : cached(false)
+        , duration(0.)
+        , cost(0.)
+    {}
+};
+
+// receives the record of every evaluation, write has to be thread safe
+class TelemetrySink {
+  public:
+    virtual ~TelemetrySink() {}
+
+    virtual void write(EvaluationRecord const& record) = 0;
+};
+
+/**
+ * writes one CSV line per evaluation. output is buffered and only flushed
+ * every few records and on destruction.
+ */
+class CsvTelemetrySink : public TelemetrySink {
+  public:
+    explicit CsvTelemetrySink(boost::filesystem::path const& path);
+    virtual ~CsvTelemetrySink() override;
+
+    virtual void write(EvaluationRecord const& record) override;
+
+    size_t getNumRecords() const { return _numRecords; }
+
+  private:
+    std::mutex _mutex;
+    std::ofstream _file;
+    size_t _numRecords;
+};
+}
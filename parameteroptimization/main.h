@@ -6,6 +6,7 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <bayesopt.hpp>
 
@@ -13,6 +14,7 @@
 #include <boost/optional.hpp>
 
 #include "Common.h"
+#include "DatasetManifest.h"
 
 namespace opt {
 
@@ -26,16 +28,47 @@ struct CommandLineOptions {
     boost::optional<DeepLocalizerPaths> deeplocalizer_paths;
 
     bool optimize_mean;
+    // number of folders optimized concurrently if optimize_mean is false
+    size_t num_jobs;
+
+    size_t num_threads;
+    size_t batch_size;
+    size_t preprocessor_cache_mb;
+
+    bool racing;
+    double racing_confidence;
+    size_t racing_min_images;
+
+    bool multi_fidelity;
+    double low_fidelity_fraction;
+    double multi_fidelity_threshold;
+
+    // output folder of an interrupted run that should be continued
+    boost::optional<std::string> resume;
 
 	CommandLineOptions(std::string const& data, size_t n_init_samples, size_t n_iterations,
                        size_t n_iter_relearn, boost::optional<DeepLocalizerPaths> deeplocalizer_paths,
-                       bool optimize_mean)
+                       bool optimize_mean, size_t num_jobs, size_t num_threads, size_t batch_size,
+                       size_t preprocessor_cache_mb, bool racing, double racing_confidence,
+                       size_t racing_min_images, bool multi_fidelity, double low_fidelity_fraction,
+                       double multi_fidelity_threshold, boost::optional<std::string> resume)
 		: data(data)
 		, n_init_samples(n_init_samples)
 		, n_iterations(n_iterations)
 		, n_iter_relearn(n_iter_relearn)
         , deeplocalizer_paths(deeplocalizer_paths)
         , optimize_mean(optimize_mean)
+        , num_jobs(num_jobs)
+        , num_threads(num_threads)
+        , batch_size(batch_size)
+        , preprocessor_cache_mb(preprocessor_cache_mb)
+        , racing(racing)
+        , racing_confidence(racing_confidence)
+        , racing_min_images(racing_min_images)
+        , multi_fidelity(multi_fidelity)
+        , low_fidelity_fraction(low_fidelity_fraction)
+        , multi_fidelity_threshold(multi_fidelity_threshold)
+        , resume(resume)
 	{}
 };
 
@@ -43,11 +76,27 @@ std::string getDateTime();
 
 boost::optional<CommandLineOptions> getCommandLineOptions(int argc, char **argv);
 
-opt::multiple_path_struct_t getTasks(boost::filesystem::path dataFolder);
+/**
+ * creates the task for the given ground truth files and their images, output
+ * is written to dataFolder. if resumeFolder is a run folder of dataFolder, it
+ * is reused as checkpoint folder, otherwise a new timestamped folder is
+ * created.
+ */
+opt::multiple_path_struct_t getTasks(boost::filesystem::path dataFolder,
+                                     DatasetManifest::ImageFilesByGroundTruthFile const& imageFilesByGroundTruthFile,
+                                     boost::optional<boost::filesystem::path> const& resumeFolder);
+
+// true if runFolder is a timestamped run folder created in dataFolder
+bool isRunFolderOf(boost::filesystem::path const& runFolder, boost::filesystem::path const& dataFolder);
 
 bopt_params getBoptParams(CommandLineOptions const &options);
 
-void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOptions &options, const bopt_params &params);
+ModelOptions getModelOptions(CommandLineOptions const &options);
+
+// if captureOutput is false, the caller is responsible for capturing the
+// output of BayesOpt, e.g. if several tasks are optimized concurrently
+void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOptions &options, const bopt_params &params,
+                        bool captureOutput);
 /*
 void optimizeParameters(const path_struct_t &task, const CommandLineOptions &options, const bopt_params &params);
 */
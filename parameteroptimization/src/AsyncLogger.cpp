@@ -0,0 +1,133 @@
+#include "AsyncLogger.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace opt {
+
+namespace {
+size_t getPowerOfTwo(size_t minimum) {
+    size_t value = 1;
+    while (value < minimum) value <<= 1;
+    return value;
+}
+
+void writeAll(int fd, std::string const& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result <= 0) return;
+        written += static_cast<size_t>(result);
+    }
+}
+}
+
+AsyncLogger::AsyncLogger(const boost::filesystem::path &logfile, size_t capacity)
+    : _entries(new Entry[getPowerOfTwo(std::max<size_t>(2, capacity))])
+    , _mask(getPowerOfTwo(std::max<size_t>(2, capacity)) - 1)
+    , _enqueuePosition(0)
+    , _dequeuePosition(0)
+    , _logfile(logfile.string(), std::ios::app)
+    , _stdoutFd(dup(STDOUT_FILENO))
+    , _stderrFd(dup(STDERR_FILENO))
+    , _stop(false)
+{
+    for (size_t i = 0; i <= _mask; ++i) {
+        _entries[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    _thread = std::thread(&AsyncLogger::drain, this);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    _stop = true;
+    _thread.join();
+
+    close(_stdoutFd);
+    close(_stderrFd);
+}
+
+void AsyncLogger::log(Level level, std::string line)
+{
+    const auto time = std::chrono::system_clock::now();
+
+    // bounded multi-producer queue, see
+    // http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+    size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+    Entry* entry;
+    while (true) {
+        entry = &_entries[position & _mask];
+        const size_t sequence = entry->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+        if (difference == 0) {
+            if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else if (difference < 0) {
+            // full, wait for the background thread instead of dropping the line
+            std::this_thread::yield();
+            position = _enqueuePosition.load(std::memory_order_relaxed);
+        } else {
+            position = _enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    entry->time  = time;
+    entry->level = level;
+    entry->line  = std::move(line);
+    entry->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool AsyncLogger::writeNext()
+{
+    Entry& entry = _entries[_dequeuePosition & _mask];
+
+    if (entry.sequence.load(std::memory_order_acquire) != _dequeuePosition + 1) return false;
+
+    const std::time_t time = std::chrono::system_clock::to_time_t(entry.time);
+    std::tm localTime;
+    localtime_r(&time, &localTime);
+
+    std::stringstream ss;
+    ss << std::put_time(&localTime, "%Y-%m-%d %X")
+       << (entry.level == Level::Error ? " - ERROR: " : " - INFO: ") << entry.line << '\n';
+    _logfile << ss.str();
+
+    writeAll(entry.level == Level::Error ? _stderrFd : _stdoutFd, entry.line + '\n');
+
+    entry.line.clear();
+    entry.sequence.store(_dequeuePosition + _mask + 1, std::memory_order_release);
+    ++_dequeuePosition;
+
+    return true;
+}
+
+void AsyncLogger::drain()
+{
+    while (true) {
+        // read the flag before draining, lines enqueued before the destructor
+        // was called are written in the last round
+        const bool stop = _stop;
+
+        bool wroteAny = false;
+        while (writeNext()) {
+            wroteAny = true;
+        }
+
+        if (stop) break;
+
+        if (wroteAny) {
+            _logfile.flush();
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    _logfile.flush();
+}
+}
@@ -1,5 +1,8 @@
 #include "Common.h"
 
+#include <algorithm>
+#include <thread>
+
 namespace opt {
 
 bool operator<(const opt::OptimizationResult &a, const opt::OptimizationResult &b) {
@@ -11,6 +14,10 @@ double getFScore(const double recall, const double precision, const double beta)
 	        ((precision * recall) / (std::pow(beta, 2) * precision + recall)));
 }
 
+size_t getDefaultNumThreads() {
+	return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
 OptimizationResult getOptimizationResult(const size_t numGroundTruth, const size_t numTruePositives,
                                          const size_t numFalsePositives, const double beta)
 {
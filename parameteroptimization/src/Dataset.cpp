@@ -0,0 +1,43 @@
+#include "Dataset.h"
+
+#include <cassert>
+
+#include <biotracker/serialization/SerializationData.h>
+
+#include "GroundTruth.h"
+
+namespace Serialization = BioTracker::Core::Serialization;
+
+namespace opt {
+
+Dataset::Dataset(const multiple_path_struct_t &task)
+{
+    for (auto const& groundTruthImagePair : task.imageFilesByGroundTruthFile) {
+        ground_truth_images_t const& images = groundTruthImagePair.second;
+        assert(images.imagePaths.size() == images.frameNumbers.size());
+
+        const Serialization::Data data = loadGroundTruth(groundTruthImagePair.first);
+
+        const size_t groundTruthIdx = _groundTruth.size();
+        for (size_t i = 0; i < images.imagePaths.size(); ++i) {
+            _images.push_back({groundTruthIdx, images.frameNumbers[i], images.imagePaths[i]});
+            _imageData.push_back(ImageStore::getInstance().get(images.imagePaths[i]));
+        }
+
+        _groundTruth.push_back(getResultsByFrame(data, images.numFrames));
+    }
+}
+
+void Dataset::setTaglists(Stage stage, std::vector<Taglist> taglists)
+{
+    assert(taglists.size() == _images.size());
+
+    std::vector<TaglistPtr>& stageTaglists = _taglists[getStageIdx(stage)];
+    stageTaglists.clear();
+    stageTaglists.reserve(taglists.size());
+
+    for (Taglist& taglist : taglists) {
+        stageTaglists.push_back(std::make_shared<const Taglist>(std::move(taglist)));
+    }
+}
+}
@@ -0,0 +1,234 @@
+#include "DatasetManifest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include "GroundTruth.h"
+
+namespace opt {
+
+namespace {
+// incremented whenever the layout of the manifest changes
+const uint32_t manifestVersion = 2;
+
+// extension of the images referenced by the ground truth files
+const std::string imageExtension = ".jpeg";
+
+std::string join(std::string const& folder, std::string const& name) {
+    return folder.empty() ? name : folder + "/" + name;
+}
+
+// images outside the folder of their ground truth file are not part of its
+// listing
+bool isInOtherFolder(std::string const& imageName) {
+    return boost::filesystem::path(imageName).has_parent_path();
+}
+}
+
+DatasetManifest::DatasetManifest(const boost::filesystem::path &dataRoot)
+    : _dataRoot(dataRoot)
+{}
+
+DatasetManifest DatasetManifest::loadAndUpdate(const boost::filesystem::path &dataRoot)
+{
+    DatasetManifest manifest(dataRoot);
+
+    manifest.load();
+
+    if (manifest.update()) {
+        manifest.save();
+    }
+
+    return manifest;
+}
+
+boost::filesystem::path DatasetManifest::getManifestPath(const boost::filesystem::path &dataRoot)
+{
+    return dataRoot / "manifest.bin";
+}
+
+bool DatasetManifest::load()
+{
+    const boost::filesystem::path manifestPath = getManifestPath(_dataRoot);
+
+    if (!boost::filesystem::is_regular_file(manifestPath)) return false;
+
+    try {
+        std::ifstream is(manifestPath.string(), std::ios::binary);
+        cereal::PortableBinaryInputArchive ar(is);
+
+        uint32_t version;
+        ar(version);
+        if (version != manifestVersion) return false;
+
+        std::map<std::string, DirectoryEntry> directories;
+        std::map<std::string, GroundTruthEntry> groundTruthFiles;
+        ar(directories, groundTruthFiles);
+
+        _directories.swap(directories);
+        _groundTruthFiles.swap(groundTruthFiles);
+    } catch (cereal::Exception const& e) {
+        std::cerr << "Unable to load manifest " << manifestPath.string() << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void DatasetManifest::save() const
+{
+    const boost::filesystem::path manifestPath = getManifestPath(_dataRoot);
+    const boost::filesystem::path tmpPath = manifestPath.string() + ".tmp";
+
+    {
+        std::ofstream os(tmpPath.string(), std::ios::binary);
+        cereal::PortableBinaryOutputArchive ar(os);
+
+        ar(manifestVersion, _directories, _groundTruthFiles);
+    }
+
+    boost::filesystem::rename(tmpPath, manifestPath);
+}
+
+bool DatasetManifest::update()
+{
+    namespace fs = boost::filesystem;
+
+    bool changed = false;
+
+    std::map<std::string, DirectoryEntry> directories;
+    std::map<std::string, GroundTruthEntry> groundTruthFiles;
+
+    std::vector<std::string> pendingFolders { "" };
+    while (!pendingFolders.empty()) {
+        const std::string folder = pendingFolders.back();
+        pendingFolders.pop_back();
+
+        const fs::path folderPath = folder.empty() ? _dataRoot : _dataRoot / folder;
+
+        // the modification time of a directory also changes if a run writes
+        // its outputs into it, so the entries of the index are compared
+        DirectoryEntry directory;
+        for (fs::directory_iterator it(folderPath), end; it != end; ++it) {
+            const std::string name = it->path().filename().string();
+
+            // symlinked folders are not followed, like in a recursive_directory_iterator.
+            // the type of the entry is known from the listing, the status of
+            // images is never queried
+            if (fs::is_directory(it->symlink_status())) {
+                directory.subdirectories.push_back(name);
+            } else if (it->path().extension() == imageExtension) {
+                directory.images.push_back(name);
+            } else if (it->path().extension() == ".tdat" && fs::is_regular_file(it->status())) {
+                directory.groundTruthFiles.push_back(name);
+            }
+        }
+
+        std::sort(directory.subdirectories.begin(), directory.subdirectories.end());
+        std::sort(directory.groundTruthFiles.begin(), directory.groundTruthFiles.end());
+        std::sort(directory.images.begin(), directory.images.end());
+
+        // new subdirectories, e.g. the output folder of a run, only change
+        // the index, the images of the folder are not matched again
+        const auto storedFolder = _directories.find(folder);
+        const bool imagesChanged = storedFolder == _directories.end() || storedFolder->second.images != directory.images;
+        changed |= storedFolder == _directories.end() || !(storedFolder->second == directory);
+
+        for (std::string const& subdirectory : directory.subdirectories) {
+            pendingFolders.push_back(join(folder, subdirectory));
+        }
+
+        for (std::string const& name : directory.groundTruthFiles) {
+            const std::string groundTruthFile = join(folder, name);
+            const fs::path groundTruthPath = folderPath / name;
+            const std::time_t groundTruthMtime = fs::last_write_time(groundTruthPath);
+
+            const auto storedGroundTruth = _groundTruthFiles.find(groundTruthFile);
+
+            GroundTruthEntry entry;
+            if (storedGroundTruth == _groundTruthFiles.end() || storedGroundTruth->second.mtime != groundTruthMtime) {
+                changed = true;
+
+                entry.mtime = groundTruthMtime;
+                // the file names are owned by the loaded data, it has to
+                // outlive the loop
+                const BioTracker::Core::Serialization::Data data = loadGroundTruth(groundTruthPath);
+                for (std::string const& fileName : data.getFilenames()) {
+                    entry.imageNames.push_back(fs::path(fileName).replace_extension(imageExtension).string());
+                }
+                resolveImages(folderPath, directory, entry);
+            } else {
+                entry = storedGroundTruth->second;
+
+                // images might have been added or removed
+                if (imagesChanged || std::any_of(entry.imageNames.begin(), entry.imageNames.end(), isInOtherFolder)) {
+                    const std::vector<std::string> images = entry.images;
+                    resolveImages(folderPath, directory, entry);
+                    changed |= entry.images != images;
+                }
+            }
+
+            groundTruthFiles.insert({groundTruthFile, std::move(entry)});
+        }
+
+        directories.insert({folder, std::move(directory)});
+    }
+
+    // removed folders or ground truth files
+    changed |= directories.size() != _directories.size() || groundTruthFiles.size() != _groundTruthFiles.size();
+
+    _directories.swap(directories);
+    _groundTruthFiles.swap(groundTruthFiles);
+
+    return changed;
+}
+
+void DatasetManifest::resolveImages(const boost::filesystem::path &folder, const DirectoryEntry &directory,
+                                    GroundTruthEntry &entry)
+{
+    entry.images.clear();
+
+    for (std::string const& imageName : entry.imageNames) {
+        const bool exists = isInOtherFolder(imageName) ?
+                    boost::filesystem::is_regular_file(folder / imageName) :
+                    std::binary_search(directory.images.begin(), directory.images.end(), imageName);
+        if (exists) {
+            entry.images.push_back(imageName);
+        }
+    }
+}
+
+DatasetManifest::ImageFilesByGroundTruthFile DatasetManifest::getImageFilesByGroundTruthFile() const
+{
+    ImageFilesByGroundTruthFile imageFilesByGroundTruthFile;
+
+    for (auto const& groundTruthFile : _groundTruthFiles) {
+        const boost::filesystem::path groundTruthPath = _dataRoot / groundTruthFile.first;
+
+        GroundTruthEntry const& entry = groundTruthFile.second;
+
+        // the existing images are a subsequence of the referenced ones
+        ground_truth_images_t images;
+        images.numFrames = entry.imageNames.size();
+        for (size_t frameNumber = 0, imageIdx = 0;
+             frameNumber < entry.imageNames.size() && imageIdx < entry.images.size(); ++frameNumber) {
+            if (entry.imageNames[frameNumber] == entry.images[imageIdx]) {
+                images.imagePaths.push_back(groundTruthPath.parent_path() / entry.images[imageIdx]);
+                images.frameNumbers.push_back(frameNumber);
+                ++imageIdx;
+            }
+        }
+
+        imageFilesByGroundTruthFile.insert({groundTruthPath, std::move(images)});
+    }
+
+    return imageFilesByGroundTruthFile;
+}
+}
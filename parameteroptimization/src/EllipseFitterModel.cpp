@@ -2,124 +2,161 @@
 
 namespace opt {
 
-EllipseFitterModel::EllipseFitterModel(bopt_params param, const multiple_path_struct_t &task, const TaglistByImage &taglist, const ParameterMaps &parameterMaps)
-    : OptimizationModel(param, task, parameterMaps, getNumDimensions())
-    , _taglistByImage(taglist)
-{}
+EllipseFitterModel::EllipseFitterModel(bopt_params param, const std::shared_ptr<const Dataset> &dataset, const ModelOptions &options, const ParameterMaps &parameterMaps)
+    : OptimizationModel(param, dataset, options, parameterMaps)
+    , _evaluatorSnapshots(createEvaluatorSnapshots(Dataset::Stage::Localizer))
+{
+    _workers.resize(getNumWorkers());
+    for (Worker& worker : _workers) {
+        worker.ellipseFitter = std::make_unique<pipeline::EllipseFitter>();
+    }
+}
 
-EllipseFitterModel::EllipseFitterModel(bopt_params param, const multiple_path_struct_t &task, const TaglistByImage &taglist)
-	: EllipseFitterModel(param, task, taglist, getDefaultLimits())
+EllipseFitterModel::EllipseFitterModel(bopt_params param, const std::shared_ptr<const Dataset> &dataset, const ModelOptions &options)
+	: EllipseFitterModel(param, dataset, options, getDefaultLimits())
 {}
 
 OptimizationModel::ParameterMaps EllipseFitterModel::getDefaultLimits()
 {
     OptimizationModel::ParameterMaps parameterMaps;
-    // TODO: use queryIdxByParameter
-    OptimizationModel::ParameterMaps::limitsByParam &limitsByParameter = parameterMaps.limitsByParameter;
+
+    auto addLimitToParameterWrapper = [&](const std::string& paramName, limits_t limits)
+    {
+        this->addLimitToParameter(paramName, limits, parameterMaps);
+    };
 
 	using namespace pipeline::settings::EllipseFitter;
-    limitsByParameter[Params::CANNY_INITIAL_HIGH]    = {25, 150};
-    limitsByParameter[Params::CANNY_VALUES_DISTANCE] = {10, 100};
-    limitsByParameter[Params::CANNY_MEAN_MIN]        = {3, 9};
-    limitsByParameter[Params::CANNY_MEAN_MAX]        = {10, 30};
+    addLimitToParameterWrapper(Params::CANNY_INITIAL_HIGH,    {25, 150});
+    addLimitToParameterWrapper(Params::CANNY_VALUES_DISTANCE, {10, 100});
+    addLimitToParameterWrapper(Params::CANNY_MEAN_MIN,        {3, 9});
+    addLimitToParameterWrapper(Params::CANNY_MEAN_MAX,        {10, 30});
 
-    limitsByParameter[Params::MIN_MAJOR_AXIS] = {20, 45};
-	limitsByParameter[Params::MAX_MAJOR_AXIS] = {46, 70};
-    limitsByParameter[Params::MIN_MINOR_AXIS] = {15, 45};
-	limitsByParameter[Params::MAX_MINOR_AXIS] = {46, 70};
+    addLimitToParameterWrapper(Params::MIN_MAJOR_AXIS, {20, 45});
+    addLimitToParameterWrapper(Params::MAX_MAJOR_AXIS, {46, 70});
+    addLimitToParameterWrapper(Params::MIN_MINOR_AXIS, {15, 45});
+    addLimitToParameterWrapper(Params::MAX_MINOR_AXIS, {46, 70});
 
-    limitsByParameter[Params::ELLIPSE_REGULARISATION] = {std::numeric_limits<double>::min(), 100.};
+    addLimitToParameterWrapper(Params::ELLIPSE_REGULARISATION, {std::numeric_limits<double>::min(), 100.});
 
-    limitsByParameter[Params::THRESHOLD_EDGE_PIXELS] = {15, 100};
-    limitsByParameter[Params::THRESHOLD_BEST_VOTE]   = {1500, 10000};
-    limitsByParameter[Params::THRESHOLD_VOTE]        = {100, 1400};
+    addLimitToParameterWrapper(Params::THRESHOLD_EDGE_PIXELS, {15, 100});
+    addLimitToParameterWrapper(Params::THRESHOLD_BEST_VOTE,   {1500, 10000});
+    addLimitToParameterWrapper(Params::THRESHOLD_VOTE,        {100, 1400});
+
+    assert(parameterMaps.queryIdxByParameter.size() == getNumDimensions());
 
     return parameterMaps;
 }
 
-void EllipseFitterModel::applyQueryToSettings(const boost::numeric::ublas::vector<double> &query, pipeline::settings::ellipsefitter_settings_t &settings)
+void EllipseFitterModel::applyQueryToSettings(const boost::numeric::ublas::vector<double> &query, pipeline::settings::ellipsefitter_settings_t &settings) const
 {
-	size_t idx = 0;
-
 	using namespace pipeline::settings::EllipseFitter;
-	setValueFromQuery<int>(settings, Params::CANNY_INITIAL_HIGH, query[idx++]);
-	setValueFromQuery<int>(settings, Params::CANNY_VALUES_DISTANCE, query[idx++]);
-	setValueFromQuery<int>(settings, Params::CANNY_MEAN_MIN, query[idx++]);
-	setValueFromQuery<int>(settings, Params::CANNY_MEAN_MAX, query[idx++]);
+	setValueFromQuery<int>(settings, Params::CANNY_INITIAL_HIGH, query);
+	setValueFromQuery<int>(settings, Params::CANNY_VALUES_DISTANCE, query);
+	setValueFromQuery<int>(settings, Params::CANNY_MEAN_MIN, query);
+	setValueFromQuery<int>(settings, Params::CANNY_MEAN_MAX, query);
 
-	setValueFromQuery<int>(settings, Params::MIN_MAJOR_AXIS, query[idx++]);
-	setValueFromQuery<int>(settings, Params::MAX_MAJOR_AXIS, query[idx++]);
-	setValueFromQuery<int>(settings, Params::MIN_MINOR_AXIS, query[idx++]);
-	setValueFromQuery<int>(settings, Params::MAX_MINOR_AXIS, query[idx++]);
+	setValueFromQuery<int>(settings, Params::MIN_MAJOR_AXIS, query);
+	setValueFromQuery<int>(settings, Params::MAX_MAJOR_AXIS, query);
+	setValueFromQuery<int>(settings, Params::MIN_MINOR_AXIS, query);
+	setValueFromQuery<int>(settings, Params::MAX_MINOR_AXIS, query);
 
-    setValueFromQuery<double>(settings, Params::ELLIPSE_REGULARISATION, query[idx++]);
+    setValueFromQuery<double>(settings, Params::ELLIPSE_REGULARISATION, query);
 
-	setValueFromQuery<int>(settings, Params::THRESHOLD_EDGE_PIXELS, query[idx++]);
-	setValueFromQuery<int>(settings, Params::THRESHOLD_BEST_VOTE, query[idx++]);
-	setValueFromQuery<int>(settings, Params::THRESHOLD_VOTE, query[idx++]);
-
-	assert(idx == getNumDimensions());
+	setValueFromQuery<int>(settings, Params::THRESHOLD_EDGE_PIXELS, query);
+	setValueFromQuery<int>(settings, Params::THRESHOLD_BEST_VOTE, query);
+	setValueFromQuery<int>(settings, Params::THRESHOLD_VOTE, query);
 }
 
 boost::optional<EllipseFitterResult> EllipseFitterModel::evaluate(pipeline::settings::ellipsefitter_settings_t &settings)
+{
+    return evaluate(settings, getAllWorkers(), getAllImages());
+}
+
+boost::optional<EllipseFitterResult> EllipseFitterModel::evaluate(pipeline::settings::ellipsefitter_settings_t &settings, WorkerRange workers,
+                                                                  const ImageIndices &imageIndices)
+{
+    loadSettings(settings, workers);
+
+    const std::vector<OptimizationResult> results = evaluateImages(workers, imageIndices);
+
+    return EllipseFitterResult(results, settings);
+}
+
+void EllipseFitterModel::loadSettings(const pipeline::settings::ellipsefitter_settings_t &settings, WorkerRange workers)
+{
+    for (size_t workerIdx = workers.first; workerIdx < workers.first + workers.count; ++workerIdx) {
+        _workers[workerIdx].ellipseFitter->loadSettings(settings);
+    }
+}
+
+std::vector<OptimizationResult> EllipseFitterModel::evaluateImages(WorkerRange workers, const ImageIndices &imageIndices)
+{
+    return evaluateInParallel<OptimizationResult>(
+                workers, imageIndices, [&](size_t workerIdx, ImageIndices const& chunkIndices)
+    {
+        return evaluateChunk(_workers[workerIdx], getStageTimes(workerIdx), chunkIndices);
+    });
+}
+
+std::vector<OptimizationResult> EllipseFitterModel::evaluateChunk(Worker &worker, StageTimes &stageTimes,
+                                                                  const ImageIndices &imageIndices) const
 {
     std::vector<OptimizationResult> results;
 
-    for (auto const& imagesByEvaluator : _imagesByEvaluator)
+    for (size_t imageIdx : imageIndices)
     {
-        GroundTruthEvaluation* evaluator = imagesByEvaluator.first.get();
-        const std::vector<boost::filesystem::path>& imagesPaths = imagesByEvaluator.second;
+        const auto imageStart = std::chrono::steady_clock::now();
+        auto start = imageStart;
 
-        _ellipseFitter.loadSettings(settings);
+        // the localizer results of the image were matched when the model was
+        // built, start from that state instead of matching them again
+        restoreEvaluator(worker.evaluator, *_evaluatorSnapshots[imageIdx]);
 
-        size_t frameNumber = 0;
-        for (const boost::filesystem::path& imagePath : imagesPaths)
-        {
-            std::vector<pipeline::Tag> tagListCopy(_taglistByImage[imagePath]);
+        // the ellipse fitter takes its taglist by value and adds its results
+        // to the candidates of its tags, so every image needs its own copy of
+        // the shared taglist
+        std::vector<pipeline::Tag> tags(_dataset->getTaglist(Dataset::Stage::Localizer, imageIdx));
+        stageTimes.add("setup", start);
 
-            evaluator->evaluateLocalizer(0, tagListCopy);
-            tagListCopy = _ellipseFitter.process(std::move(tagListCopy));
-            evaluator->evaluateEllipseFitter(tagListCopy);
+        start = std::chrono::steady_clock::now();
+        tags = worker.ellipseFitter->process(std::move(tags));
+        stageTimes.add("ellipsefitter", start);
 
-            const auto ellipseFitterResult = evaluator->getEllipsefitterResults();
+        start = std::chrono::steady_clock::now();
+        worker.evaluator->evaluateEllipseFitter(tags);
+        stageTimes.add("evaluation", start);
 
-            const size_t numGroundTruth    = ellipseFitterResult.taggedGridsOnFrame.size();
-            const size_t numTruePositives  = ellipseFitterResult.truePositives.size();
-            const size_t numFalsePositives = ellipseFitterResult.falsePositives.size();
+        const auto ellipseFitterResult = worker.evaluator->getEllipsefitterResults();
 
-            results.push_back(getOptimizationResult(numGroundTruth, numTruePositives, numFalsePositives, 0.5));
+        const size_t numGroundTruth    = ellipseFitterResult.taggedGridsOnFrame.size();
+        const size_t numTruePositives  = ellipseFitterResult.truePositives.size();
+        const size_t numFalsePositives = ellipseFitterResult.falsePositives.size();
 
-            ++frameNumber;
+        results.push_back(getOptimizationResult(numGroundTruth, numTruePositives, numFalsePositives, 0.5));
 
-            evaluator->reset();
-        }
+        stageTimes.addImage(imageStart);
     }
 
-    return EllipseFitterResult(results, settings);
+    return results;
 }
 
-double EllipseFitterModel::evaluateSample(const boost::numeric::ublas::vector<double> &query)
+double EllipseFitterModel::evaluateQuery(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+                                         Fidelity fidelity)
 {
 	// BayesOpt does not check reachability during initial sampling
 	//if (!checkReachability(query)) return 0.;
 
-	applyQueryToSettings(query, _settings);
-
-	_settings.print();
-
-	const auto result = evaluate(_settings);
-
-	double score = result ? (1 - result.get().fscore) : 1;
+	pipeline::settings::ellipsefitter_settings_t settings = _settings;
 
-	if (result) {
-		std::cout << "F0.5-Score: " << (1 - score) << std::endl
-				  << std::endl;
-	} else {
-		std::cout << "Invalid results" << std::endl
-				  << std::endl;
-	}
+	applyQueryToSettings(query, settings);
 
-	return score;
+	return evaluateSettings<OptimizationResult>(
+	            query, workers, fidelity, getSettingsString(settings),
+	            [&]() { loadSettings(settings, workers); },
+	            [&](ImageIndices const& imageIndices)
+	{
+		return evaluateImages(workers, imageIndices);
+	}, [](OptimizationResult const& result) { return 1 - result.fscore; });
 }
 
 bool EllipseFitterModel::checkReachability(const boost::numeric::ublas::vector<double> &query)
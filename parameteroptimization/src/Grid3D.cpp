@@ -1,5 +1,9 @@
 #include "Grid3D.h"
 
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
 #include <numeric>
 
 #include <biotracker/serialization/types.hpp>
@@ -8,6 +12,7 @@
 #include <cereal/types/array.hpp>
 
 #include <cereal/archives/json.hpp>
+#include <cereal/archives/portable_binary.hpp>
 #include <cereal/types/polymorphic.hpp>
 
 #include <pipeline/util/CvHelper.h>
@@ -30,13 +35,11 @@ Grid3D::Grid3D(cv::Point2i center, double radius_px, double angle_z, double angl
     , _angle_z(angle_z)
     , _angle_y(angle_y)
     , _angle_x(angle_x)
-    , _coordinates2D(NUM_CELLS)
     , _transparency(0.5)
     , _bitsTouched(false)
     , _isSettable(true)
-{
-	prepare_visualization_data();
-}
+    , _visualizationDataValid(false)
+{}
 
 Grid3D::~Grid3D() = default;
 
@@ -111,33 +114,128 @@ Grid3D::coordinates3D_t Grid3D::generate_3D_base_coordinates() {
 }
 
 
+/**
+ * rotates, scales and projects the base mesh of numGrids grids
+ *
+ * @param rotation rotation matrices in structure-of-arrays form, coefficient
+ *        (r, c) of grid g at (3 * r + c) * numGrids + g
+ * @param radius world radii of the grids
+ * @param x, y projected points, point j of grid g at j * numGrids + g
+ */
+void Grid3D::project_mesh(size_t numGrids, const double *rotation, const double *radius, int *x, int *y)
+{
+	for (size_t j = 0; j < NUM_MESH_POINTS; ++j)
+	{
+		const cv::Point3d &p = j < INDEX_MESH_LINE_BEGIN ?
+		            _coordinates3D._rings[j / POINTS_PER_RING][j % POINTS_PER_RING] :
+		            _coordinates3D._inner_line[j - INDEX_MESH_LINE_BEGIN];
+
+		int *x_j = x + j * numGrids;
+		int *y_j = y + j * numGrids;
+
+		// plain loop over contiguous arrays without calls or branches, so
+		// that it can be vectorized (GCC 12 does at -O3). std::round is a
+		// library call that prevents this, the points are rounded half away
+		// from zero by adding +-0.5 and truncating instead.
+		for (size_t g = 0; g < numGrids; ++g)
+		{
+			// rotate and scale point (aka vector)
+			const double px = rotation[0 * numGrids + g] * p.x + rotation[1 * numGrids + g] * p.y + rotation[2 * numGrids + g] * p.z;
+			const double py = rotation[3 * numGrids + g] * p.x + rotation[4 * numGrids + g] * p.y + rotation[5 * numGrids + g] * p.z;
+			const double pz = rotation[6 * numGrids + g] * p.x + rotation[7 * numGrids + g] * p.y + rotation[8 * numGrids + g] * p.z;
+
+			// project onto image plane
+			const double projectedX = (px / (pz + FOCAL_LENGTH)) * radius[g];
+			const double projectedY = (py / (pz + FOCAL_LENGTH)) * radius[g];
+
+			x_j[g] = static_cast<int>(projectedX + std::copysign(0.5, projectedX));
+			y_j[g] = static_cast<int>(projectedY + std::copysign(0.5, projectedY));
+		}
+	}
+}
+
+void Grid3D::project(const parameters_soa_t &parameters, points_soa_t &points)
+{
+	const size_t numGrids = parameters.size();
+
+	std::vector<double> rotation(9 * numGrids);
+	for (size_t g = 0; g < numGrids; ++g)
+	{
+		const auto rotationMatrix = CvHelper::rotationMatrix(parameters.angle_z[g], parameters.angle_y[g], parameters.angle_x[g]);
+		for (size_t k = 0; k < 9; ++k)
+		{
+			rotation[k * numGrids + g] = rotationMatrix(static_cast<int>(k / 3), static_cast<int>(k % 3));
+		}
+	}
+
+	points.x.resize(NUM_MESH_POINTS * numGrids);
+	points.y.resize(NUM_MESH_POINTS * numGrids);
+
+	project_mesh(numGrids, rotation.data(), parameters.radius.data(), points.x.data(), points.y.data());
+}
+
+void Grid3D::prepareVisualizationData(std::vector<Grid3D*> const& grids)
+{
+	parameters_soa_t parameters;
+	for (const Grid3D *grid : grids)
+	{
+		parameters.radius.push_back(grid->_radius);
+		parameters.angle_z.push_back(grid->_angle_z);
+		parameters.angle_y.push_back(grid->_angle_y);
+		parameters.angle_x.push_back(grid->_angle_x);
+	}
+
+	points_soa_t points;
+	project(parameters, points);
+
+	for (size_t g = 0; g < grids.size(); ++g)
+	{
+		grids[g]->prepare_visualization_data(grids[g]->generate_2D_coordinates(points.x.data() + g, points.y.data() + g, grids.size()));
+	}
+}
+
 /**
  * rotates and scales the base mesh according to given parameter set
  */
-Grid3D::coordinates2D_t Grid3D::generate_3D_coordinates_from_parameters_and_project_to_2D() 
+Grid3D::coordinates2D_t Grid3D::generate_3D_coordinates_from_parameters_and_project_to_2D() const
+{
+	const auto rotationMatrix = CvHelper::rotationMatrix(_angle_z, _angle_y, _angle_x);
+
+	double rotation[9];
+	for (size_t k = 0; k < 9; ++k)
+	{
+		rotation[k] = rotationMatrix(static_cast<int>(k / 3), static_cast<int>(k % 3));
+	}
+
+	int x[NUM_MESH_POINTS];
+	int y[NUM_MESH_POINTS];
+	project_mesh(1, rotation, &_radius, x, y);
+
+	return generate_2D_coordinates(x, y, 1);
+}
+
+/**
+ * arranges the projected mesh points of the grid (point j at index j * stride)
+ * and updates the bounding box and interaction points
+ */
+Grid3D::coordinates2D_t Grid3D::generate_2D_coordinates(const int *x, const int *y, size_t stride) const
 {
-	_interactionPoints.clear();
+	size_t interactionIdx = 0;
 
 	// output variable
 	coordinates2D_t result;
 
-	const auto rotationMatrix = CvHelper::rotationMatrix(_angle_z, _angle_y, _angle_x);
-
 	int minx = INT_MAX, miny = INT_MAX;
 	int maxx = INT_MIN, maxy = INT_MIN;
 
 	// iterate over all rings
-	for (size_t r = 0; r < _coordinates3D._rings.size(); ++r)
+	for (size_t r = 0; r < result._rings.size(); ++r)
 	{
 		// iterate over all points in ring
-		for (size_t i = 0; i < _coordinates3D._rings[r].size(); ++i)
+		for (size_t i = 0; i < result._rings[r].size(); ++i)
 		{
-			// rotate and scale point (aka vector)
-			const cv::Point3d p = rotationMatrix * _coordinates3D._rings[r][i];
-
-			// project onto image plane
-			const cv::Point2i projectedPoint(static_cast<int>(round((p.x / (p.z + FOCAL_LENGTH))  * _radius)),
-			                                 static_cast<int>(round((p.y / (p.z + FOCAL_LENGTH)) * _radius)));
+			const size_t j = r * POINTS_PER_RING + i;
+			const cv::Point2i projectedPoint(x[j * stride], y[j * stride]);
 
 			// determine outer points of bounding box
 			if (r == OUTER_RING) {
@@ -147,38 +245,35 @@ Grid3D::coordinates2D_t Grid3D::generate_3D_coordinates_from_parameters_and_proj
 				maxy = std::max(maxy, projectedPoint.y);
 			}
 
-			result._rings[r][i] = std::move(projectedPoint);
+			result._rings[r][i] = projectedPoint;
 
 			if (r == MIDDLE_RING)
 				if ( (i % POINTS_PER_MIDDLE_CELL) == POINTS_PER_MIDDLE_CELL / 2 )
-					_interactionPoints.push_back(0.5*(result._rings[r][i] + result._rings[r - 1][i]));
+					_interactionPoints[interactionIdx++] = 0.5*(result._rings[r][i] + result._rings[r - 1][i]);
 		}
 	}
 
 	_boundingBox = cv::Rect(minx, miny, maxx - minx, maxy - miny);
 
-	// iterate over points of inner ring
+	// iterate over points of inner line
 	for (size_t i = 0; i < POINTS_PER_LINE; ++i)
 	{
-		// rotate point (aka vector)
-		const cv::Point3d p = rotationMatrix * _coordinates3D._inner_line[i];
-
-		// project onto image plane
-		const cv::Point   p2(static_cast<int>(round((p.x / (p.z + FOCAL_LENGTH))  * _radius)),
-		                     static_cast<int>(round((p.y / (p.z + FOCAL_LENGTH)) * _radius)));
+		const size_t j = INDEX_MESH_LINE_BEGIN + i;
+		const cv::Point p2(x[j * stride], y[j * stride]);
 
 		result._inner_line[i] = p2;
 
 		// if center point reached: save point to interaction-points-list
 		if (i == POINTS_PER_LINE / 2)
 		{
-			_interactionPoints.push_back( p2 );
+			_interactionPoints[interactionIdx++] = p2;
 		}
 
 	}
 
 	// the last interaction point is P1
-	_interactionPoints.push_back(result._outer_ring[0]);
+	_interactionPoints[interactionIdx++] = result._outer_ring[0];
+	assert(interactionIdx == NUM_INTERACTION_POINTS);
 
 	return result;
 }
@@ -187,65 +282,76 @@ Grid3D::coordinates2D_t Grid3D::generate_3D_coordinates_from_parameters_and_proj
 /**
 * performs all computations required to draw the tag 
 *
-* has to be called whenever a parameter of the grid is changed (except _center)
-* i.e. in the constructor and in most of the setters (except setCenter ...)
+* is called on the first draw, hit-test or bounding box query after a
+* parameter of the grid changed (except _center), so that grids which are
+* only loaded never project their mesh
 */
-void Grid3D::prepare_visualization_data()
+void Grid3D::prepare_visualization_data() const
 {
 	// apply rotations and scaling (the basic parameters)
-	const auto points_2d = generate_3D_coordinates_from_parameters_and_project_to_2D();
+	prepare_visualization_data(generate_3D_coordinates_from_parameters_and_project_to_2D());
+}
 
+/**
+ * builds the polygons of the tag from its projected mesh
+ */
+void Grid3D::prepare_visualization_data(const coordinates2D_t &points_2d) const
+{
 	// outer ring
 	{
-		auto &vec = _coordinates2D[INDEX_OUTER_WHITE_RING];
-		vec.clear();
+		auto it = _polygonPoints.begin() + OFFSET_OUTER_WHITE_RING;
+
+		it = std::copy(points_2d._outer_ring.cbegin(), points_2d._outer_ring.cend(), it);
+		*it++ = points_2d._outer_ring[0]; // add first point to close circle
 
-		vec.insert(vec.end(), points_2d._outer_ring.cbegin(), points_2d._outer_ring.cend());
-		vec.push_back(points_2d._outer_ring[0]); // add first point to close circle
+		assert(it == _polygonPoints.begin() + OFFSET_OUTER_WHITE_RING + POINTS_OUTER_WHITE_RING);
 	}
 
 
 	// inner ring: white half
 	{
-		auto &vec = _coordinates2D[INDEX_INNER_WHITE_SEMICIRCLE];
-		vec.clear();
+		auto it = _polygonPoints.begin() + OFFSET_INNER_WHITE_SEMICIRCLE;
 
 		const size_t index_270_deg_begin = POINTS_PER_RING * 3 / 4;
 		const size_t index_90_deg_end    = POINTS_PER_RING * 1 / 4 + 1;
 
-		vec.insert(vec.end(), points_2d._inner_ring.cbegin() + index_270_deg_begin, points_2d._inner_ring.cend());
-		vec.insert(vec.end(), points_2d._inner_ring.cbegin(), points_2d._inner_ring.cbegin() + index_90_deg_end);
+		it = std::copy(points_2d._inner_ring.cbegin() + index_270_deg_begin, points_2d._inner_ring.cend(), it);
+		it = std::copy(points_2d._inner_ring.cbegin(), points_2d._inner_ring.cbegin() + index_90_deg_end, it);
+
+		assert(it == _polygonPoints.begin() + OFFSET_INNER_WHITE_SEMICIRCLE + POINTS_INNER_WHITE_SEMICIRCLE);
 	}
 
 	// black semicircle plus curved center line
 	{
-		auto &vec = _coordinates2D[INDEX_INNER_BLACK_SEMICIRCLE];
-		vec.clear();
+		auto it = _polygonPoints.begin() + OFFSET_INNER_BLACK_SEMICIRCLE;
 
 		const size_t index_90_deg_begin = POINTS_PER_RING * 1 / 4;
 		const size_t index_270_deg_end  = POINTS_PER_RING * 3 / 4 + 1;
 
-		vec.insert(vec.end(), points_2d._inner_ring.cbegin() + index_90_deg_begin, points_2d._inner_ring.cbegin() + index_270_deg_end);
-		vec.insert(vec.end(), points_2d._inner_line.crbegin(), points_2d._inner_line.crend());
+		it = std::copy(points_2d._inner_ring.cbegin() + index_90_deg_begin, points_2d._inner_ring.cbegin() + index_270_deg_end, it);
+		it = std::copy(points_2d._inner_line.crbegin(), points_2d._inner_line.crend(), it);
+
+		assert(it == _polygonPoints.begin() + OFFSET_INNER_BLACK_SEMICIRCLE + POINTS_INNER_BLACK_SEMICIRCLE);
 	}
 
 	// cells
 	{
 		for (size_t i = 0; i < NUM_MIDDLE_CELLS; ++i)
 		{
-			auto &vec = _coordinates2D[INDEX_MIDDLE_CELLS_BEGIN + i];
-			vec.clear();
+			auto it = _polygonPoints.begin() + polygonOffset(INDEX_MIDDLE_CELLS_BEGIN + i);
 
 			const size_t index_begin    = POINTS_PER_MIDDLE_CELL * i;
 			const size_t index_end      = POINTS_PER_MIDDLE_CELL * (i + 1);
 			const size_t index_end_elem = index_end < POINTS_PER_RING ? index_end : 0;
 
-			vec.insert(vec.end(), points_2d._middle_ring.cbegin() + index_begin, points_2d._middle_ring.cbegin() + index_end);
+			it = std::copy(points_2d._middle_ring.cbegin() + index_begin, points_2d._middle_ring.cbegin() + index_end, it);
 
-			vec.push_back(points_2d._middle_ring[index_end_elem]);
-			vec.push_back(points_2d._inner_ring[index_end_elem]);
+			*it++ = points_2d._middle_ring[index_end_elem];
+			*it++ = points_2d._inner_ring[index_end_elem];
 		}
 	}
+
+	_visualizationDataValid = true;
 }
 
 
@@ -266,11 +372,11 @@ void Grid3D::draw(cv::Mat &img, const cv::Point &center, const bool isActive) co
 
 	for (size_t i = INDEX_MIDDLE_CELLS_BEGIN; i < INDEX_MIDDLE_CELLS_BEGIN + NUM_MIDDLE_CELLS; ++i)
 	{
-		CvHelper::drawPolyline(img, _coordinates2D, i, white, false, center);
+		draw_polyline(img, i, white, center);
 	}
-	CvHelper::drawPolyline(img, _coordinates2D, INDEX_OUTER_WHITE_RING,       outerColor, false, center);
-	CvHelper::drawPolyline(img, _coordinates2D, INDEX_INNER_WHITE_SEMICIRCLE, white,      false, center);
-	CvHelper::drawPolyline(img, _coordinates2D, INDEX_INNER_BLACK_SEMICIRCLE, black,      false, center);
+	draw_polyline(img, INDEX_OUTER_WHITE_RING,       outerColor, center);
+	draw_polyline(img, INDEX_INNER_WHITE_SEMICIRCLE, white,      center);
+	draw_polyline(img, INDEX_INNER_BLACK_SEMICIRCLE, black,      center);
 
 	for (size_t i = 0; i < NUM_MIDDLE_CELLS; ++i)
 	{
@@ -281,11 +387,29 @@ void Grid3D::draw(cv::Mat &img, const cv::Point &center, const bool isActive) co
 
 }
 
+/**
+ * draws the (open) polygon with the given index, shifted by offset
+ */
+void Grid3D::draw_polyline(cv::Mat &img, size_t index, const cv::Scalar &color, const cv::Point &offset) const
+{
+	// cv::polylines has no offset parameter, shift the points into a buffer on the stack
+	std::array<cv::Point, NUM_POLYGON_POINTS> shifted;
+
+	const points_view_t polygon = getPolygon(index);
+	std::transform(polygon.begin(), polygon.end(), shifted.begin(), [&](const cv::Point &p) { return p + offset; });
+
+	const cv::Point *points = shifted.data();
+	const int numPoints     = static_cast<int>(polygon.size());
+	cv::polylines(img, &points, &numPoints, 1, false, color);
+}
+
 /**
 * draw grid on image. this function implements the transparency feature. 
 */
 void Grid3D::draw(cv::Mat &img, const bool isActive) const
 {
+	ensure_visualization_data();
+
 	const int radius = static_cast<int>(std::ceil(_radius));
 	const cv::Point subimage_origin( std::max(       0, _center.x - radius), std::max(       0, _center.y - radius) );
 	const cv::Point subimage_end   ( std::min(img.cols, _center.x + radius), std::min(img.rows, _center.y + radius) );
@@ -304,22 +428,53 @@ void Grid3D::draw(cv::Mat &img, const bool isActive) const
 	}
 }
 
+void Grid3D::render(cv::Mat &img) const
+{
+	ensure_visualization_data();
+
+	auto fill = [&](const points_view_t &polygon, const cv::Scalar &color) {
+		const cv::Point *points = polygon.data();
+		const int numPoints     = static_cast<int>(polygon.size());
+		cv::fillPoly(img, &points, &numPoints, 1, color, CV_AA, 0, _center);
+	};
+
+	fill(getPolygon(INDEX_OUTER_WHITE_RING), cv::Scalar(255));
+
+	for (size_t i = 0; i < NUM_MIDDLE_CELLS; ++i)
+	{
+		// the polygon of a cell ends on the inner ring, the inner ring point
+		// it starts at is the last point of the previous cell
+		const size_t previous = INDEX_MIDDLE_CELLS_BEGIN + (i + NUM_MIDDLE_CELLS - 1) % NUM_MIDDLE_CELLS;
+
+		const points_view_t polygon = getPolygon(INDEX_MIDDLE_CELLS_BEGIN + i);
+
+		std::array<cv::Point, POINTS_PER_CELL_POLYGON + 1> cell;
+		std::copy(polygon.begin(), polygon.end(), cell.begin());
+		cell.back() = getPolygon(previous).back();
+
+		fill(points_view_t(cell.data(), cell.size()), tribool2Color(_ID[i]));
+	}
+
+	fill(getPolygon(INDEX_INNER_WHITE_SEMICIRCLE), cv::Scalar(255));
+	fill(getPolygon(INDEX_INNER_BLACK_SEMICIRCLE), cv::Scalar(0));
+}
+
 void Grid3D::setXRotation(double angle)
 {
 	_angle_x = angle;
-	prepare_visualization_data();
+	invalidate_visualization_data();
 }
 
 void Grid3D::setYRotation(double angle)
 {
 	_angle_y = angle;
-	prepare_visualization_data();
+	invalidate_visualization_data();
 }
 
 void Grid3D::setZRotation(double angle)
 {
 	_angle_z = angle;
-	prepare_visualization_data();
+	invalidate_visualization_data();
 }
 
 void Grid3D::setCenter(cv::Point c)
@@ -339,6 +494,8 @@ void Grid3D::setTransparency(float transparency) {
 */
 int Grid3D::getKeyPointIndex(cv::Point p) const
 {
+	ensure_visualization_data();
+
 	for (size_t i = 0; i < _interactionPoints.size(); ++i)
 	{
 		if (cv::norm(_center + _interactionPoints[i] - p) < (_radius / 10) )
@@ -408,14 +565,14 @@ void Grid3D::zRotateTowardsPointInPlane(cv::Point p)
 	_angle_y = axis.y;
 	_angle_z = atan2(d_p.y, d_p.x);
 
-	prepare_visualization_data();
+	invalidate_visualization_data();
 }
 
 void Grid3D::xyRotateIntoPlane(float angle_y, float angle_x)
 {
 	_angle_x = angle_x;
 	_angle_y = angle_y;
-	prepare_visualization_data();
+	invalidate_visualization_data();
 }
 
 void Grid3D::toggleTransparency()
@@ -426,11 +583,13 @@ void Grid3D::toggleTransparency()
 void Grid3D::setWorldRadius(const double radius)
 {
 	_radius = radius;
-	prepare_visualization_data();
+	invalidate_visualization_data();
 }
 
 cv::Rect Grid3D::getBoundingBox() const
 {
+	ensure_visualization_data();
+
 	return cv::Rect(_boundingBox.tl() + _center,
 	                _boundingBox.size());
 }
@@ -4,127 +4,180 @@
 
 namespace opt {
 
-GridfitterModel::GridfitterModel(bopt_params param, const multiple_path_struct_t &task, const TaglistByImage &taglistEllipseFitter, const ParameterMaps &parameterMaps)
-    : OptimizationModel(param, task, parameterMaps, getNumDimensions())
-	, _taglistEllipseFitter(taglistEllipseFitter)
-{}
+GridfitterModel::GridfitterModel(bopt_params param, const std::shared_ptr<const Dataset> &dataset, const ModelOptions &options, const ParameterMaps &parameterMaps)
+    : OptimizationModel(param, dataset, options, parameterMaps)
+	, _evaluatorSnapshots(createEvaluatorSnapshots(Dataset::Stage::EllipseFitter))
+{
+    _workers.resize(getNumWorkers());
+    for (Worker& worker : _workers) {
+        worker.gridfitter = std::make_unique<pipeline::GridFitter>();
+        worker.decoder    = std::make_unique<pipeline::Decoder>();
+    }
+}
 
-GridfitterModel::GridfitterModel(bopt_params param, const multiple_path_struct_t &task, const TaglistByImage &taglistEllipseFitter)
-    : GridfitterModel(param, task, taglistEllipseFitter, getDefaultLimits())
+GridfitterModel::GridfitterModel(bopt_params param, const std::shared_ptr<const Dataset> &dataset, const ModelOptions &options)
+    : GridfitterModel(param, dataset, options, getDefaultLimits())
 {}
 
 OptimizationModel::ParameterMaps GridfitterModel::getDefaultLimits()
 {
     OptimizationModel::ParameterMaps parameterMaps;
-    // TODO: use queryIdxByParameter
-    OptimizationModel::ParameterMaps::limitsByParam &limitsByParameter = parameterMaps.limitsByParameter;
+
+    auto addLimitToParameterWrapper = [&](const std::string& paramName, limits_t limits)
+    {
+        this->addLimitToParameter(paramName, limits, parameterMaps);
+    };
 
 	using namespace pipeline::settings::Gridfitter;
-	limitsByParameter[Params::ERR_FUNC_ALPHA_INNER] = {0., 1.};
-	limitsByParameter[Params::ERR_FUNC_ALPHA_OUTER] = {0., 1.};
-	limitsByParameter[Params::ERR_FUNC_ALPHA_VARIANCE] = {0., 1.};
-	limitsByParameter[Params::ERR_FUNC_ALPHA_OUTER_EDGE] = {0., 1.};
-	limitsByParameter[Params::ERR_FUNC_ALPHA_INNER_EDGE] = {0., 1.};
+	addLimitToParameterWrapper(Params::ERR_FUNC_ALPHA_INNER, {0., 1.});
+	addLimitToParameterWrapper(Params::ERR_FUNC_ALPHA_OUTER, {0., 1.});
+	addLimitToParameterWrapper(Params::ERR_FUNC_ALPHA_VARIANCE, {0., 1.});
+	addLimitToParameterWrapper(Params::ERR_FUNC_ALPHA_OUTER_EDGE, {0., 1.});
+	addLimitToParameterWrapper(Params::ERR_FUNC_ALPHA_INNER_EDGE, {0., 1.});
 
-    limitsByParameter[Params::SOBEL_THRESHOLD] = {0., 1.};
+    addLimitToParameterWrapper(Params::SOBEL_THRESHOLD, {0., 1.});
 
-	limitsByParameter[Params::ADAPTIVE_BLOCK_SIZE] = {3., 61.};
-	limitsByParameter[Params::ADAPTIVE_C] = {0., 255.};
+	addLimitToParameterWrapper(Params::ADAPTIVE_BLOCK_SIZE, {3., 61.});
+	addLimitToParameterWrapper(Params::ADAPTIVE_C, {0., 255.});
 
-	limitsByParameter[Params::GRADIENT_ERROR_THRESHOLD] = {0., 1.};
+	addLimitToParameterWrapper(Params::GRADIENT_ERROR_THRESHOLD, {0., 1.});
 
-	limitsByParameter[Params::EPS_ANGLE] = {std::numeric_limits<double>::min(), 10.};
-	limitsByParameter[Params::EPS_POS] = {1, 5};
-	limitsByParameter[Params::EPS_SCALE] = {std::numeric_limits<double>::min(), 10.};
-	limitsByParameter[Params::ALPHA] = {std::numeric_limits<double>::min(), 100.};
+	addLimitToParameterWrapper(Params::EPS_ANGLE, {std::numeric_limits<double>::min(), 10.});
+	addLimitToParameterWrapper(Params::EPS_POS, {1, 5});
+	addLimitToParameterWrapper(Params::EPS_SCALE, {std::numeric_limits<double>::min(), 10.});
+	addLimitToParameterWrapper(Params::ALPHA, {std::numeric_limits<double>::min(), 100.});
+
+    assert(parameterMaps.queryIdxByParameter.size() == getNumDimensions());
 
     return parameterMaps;
 }
 
-void GridfitterModel::applyQueryToSettings(const boost::numeric::ublas::vector<double> &query, pipeline::settings::gridfitter_settings_t &settings)
+void GridfitterModel::applyQueryToSettings(const boost::numeric::ublas::vector<double> &query, pipeline::settings::gridfitter_settings_t &settings) const
 {
-	size_t idx = 0;
-
 	using namespace pipeline::settings::Gridfitter;
-	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_INNER, query[idx++]);
-	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_OUTER, query[idx++]);
-	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_VARIANCE, query[idx++]);
-	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_OUTER_EDGE, query[idx++]);
-	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_INNER_EDGE, query[idx++]);
+	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_INNER, query);
+	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_OUTER, query);
+	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_VARIANCE, query);
+	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_OUTER_EDGE, query);
+	setValueFromQuery<double>(settings, Params::ERR_FUNC_ALPHA_INNER_EDGE, query);
 
-    setValueFromQuery<double>(settings, Params::SOBEL_THRESHOLD, query[idx++]);
+    setValueFromQuery<double>(settings, Params::SOBEL_THRESHOLD, query);
 
-	setOddValueFromQuery<int>(settings, Params::ADAPTIVE_BLOCK_SIZE, query[idx++]);
-	setValueFromQuery<double>(settings, Params::ADAPTIVE_C, query[idx++]);
+	setOddValueFromQuery<int>(settings, Params::ADAPTIVE_BLOCK_SIZE, query);
+	setValueFromQuery<double>(settings, Params::ADAPTIVE_C, query);
 
-	setValueFromQuery<double>(settings, Params::GRADIENT_ERROR_THRESHOLD, query[idx++]);
+	setValueFromQuery<double>(settings, Params::GRADIENT_ERROR_THRESHOLD, query);
 
-	setValueFromQuery<double>(settings, Params::EPS_ANGLE, query[idx++]);
-	setValueFromQuery<int>(settings, Params::EPS_POS, query[idx++]);
-	setValueFromQuery<double>(settings, Params::EPS_SCALE, query[idx++]);
-	setValueFromQuery<double>(settings, Params::ALPHA, query[idx++]);
-
-	assert(idx == getNumDimensions());
+	setValueFromQuery<double>(settings, Params::EPS_ANGLE, query);
+	setValueFromQuery<int>(settings, Params::EPS_POS, query);
+	setValueFromQuery<double>(settings, Params::EPS_SCALE, query);
+	setValueFromQuery<double>(settings, Params::ALPHA, query);
 }
 
 boost::optional<GridfitterResult> GridfitterModel::evaluate(pipeline::settings::gridfitter_settings_t &settings)
+{
+    return evaluate(settings, getAllWorkers(), getAllImages());
+}
+
+boost::optional<GridfitterResult> GridfitterModel::evaluate(pipeline::settings::gridfitter_settings_t &settings, WorkerRange workers,
+                                                            const ImageIndices &imageIndices)
+{
+    loadSettings(settings, workers);
+
+    const std::vector<GridfitterResult> results = evaluateImages(workers, settings, imageIndices);
+
+    return GridfitterResult(results, settings);
+}
+
+void GridfitterModel::loadSettings(const pipeline::settings::gridfitter_settings_t &settings, WorkerRange workers)
+{
+    for (size_t workerIdx = workers.first; workerIdx < workers.first + workers.count; ++workerIdx) {
+        _workers[workerIdx].gridfitter->loadSettings(settings);
+    }
+}
+
+std::vector<GridfitterResult> GridfitterModel::evaluateImages(WorkerRange workers,
+                                                              const pipeline::settings::gridfitter_settings_t &settings,
+                                                              const ImageIndices &imageIndices)
+{
+    return evaluateInParallel<GridfitterResult>(
+                workers, imageIndices, [&](size_t workerIdx, ImageIndices const& chunkIndices)
+    {
+        return evaluateChunk(_workers[workerIdx], getStageTimes(workerIdx), settings, chunkIndices);
+    });
+}
+
+std::vector<GridfitterResult> GridfitterModel::evaluateChunk(Worker &worker, StageTimes &stageTimes,
+                                                             const pipeline::settings::gridfitter_settings_t &settings,
+                                                             const ImageIndices &imageIndices) const
 {
     std::vector<GridfitterResult> results;
 
-    for (auto const& imagesByEvaluator : _imagesByEvaluator)
+    for (size_t imageIdx : imageIndices)
     {
-        GroundTruthEvaluation* evaluator = imagesByEvaluator.first.get();
-        const std::vector<boost::filesystem::path>& imagesPaths = imagesByEvaluator.second;
+        const auto imageStart = std::chrono::steady_clock::now();
+        auto start = imageStart;
+
+        // the localizer results of the image were matched when the model was
+        // built, start from that state instead of matching them again
+        restoreEvaluator(worker.evaluator, *_evaluatorSnapshots[imageIdx]);
 
-        _gridfitter.loadSettings(settings);
+        // the grid fitter and the decoder take their taglist by value and add
+        // their results to the candidates of its tags, so every image needs
+        // its own copy of the shared taglist
+        std::vector<pipeline::Tag> tags(_dataset->getTaglist(Dataset::Stage::EllipseFitter, imageIdx));
 
-        size_t frameNumber = 0;
-        for (const boost::filesystem::path& imagePath : imagesPaths)
-        {
-            std::vector<pipeline::Tag> tagListCopy(_taglistEllipseFitter[imagePath]);
+        // the grid fitter evaluation refers to the tags matched here, so the
+        // ellipse fitter results have to be matched with the copy
+        worker.evaluator->evaluateEllipseFitter(tags);
+        stageTimes.add("setup", start);
 
-            evaluator->evaluateLocalizer(0, tagListCopy);
-            evaluator->evaluateEllipseFitter(tagListCopy);
+        start = std::chrono::steady_clock::now();
+        tags = worker.gridfitter->process(std::move(tags));
+        stageTimes.add("gridfitter", start);
 
-            tagListCopy = _gridfitter.process(std::move(tagListCopy));
-            evaluator->evaluateGridFitter();
-            tagListCopy = _decoder.process(std::move(tagListCopy));
-            evaluator->evaluateDecoder();
+        start = std::chrono::steady_clock::now();
+        worker.evaluator->evaluateGridFitter();
+        stageTimes.add("evaluation", start);
 
-            const auto decoderResult = evaluator->getDecoderResults();
+        start = std::chrono::steady_clock::now();
+        tags = worker.decoder->process(std::move(tags));
+        stageTimes.add("decoder", start);
 
-            const boost::optional<double> avgHamming = decoderResult.getAverageHammingDistanceNormalized();
+        start = std::chrono::steady_clock::now();
+        worker.evaluator->evaluateDecoder();
+        stageTimes.add("evaluation", start);
 
-            GridfitterResult result(avgHamming ? avgHamming.get() : 1., settings);
+        const auto decoderResult = worker.evaluator->getDecoderResults();
 
-            results.push_back(result);
+        const boost::optional<double> avgHamming = decoderResult.getAverageHammingDistanceNormalized();
 
-            ++frameNumber;
+        GridfitterResult result(avgHamming ? avgHamming.get() : 1., settings);
 
-            evaluator->reset();
-        }
+        results.push_back(result);
+
+        stageTimes.addImage(imageStart);
     }
 
-    return GridfitterResult(results, settings);
+    return results;
 }
 
-double GridfitterModel::evaluateSample(const boost::numeric::ublas::vector<double> &query)
+double GridfitterModel::evaluateQuery(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+                                      Fidelity fidelity)
 {
 	if (!checkReachability(query)) return std::numeric_limits<double>::max();
 
-	applyQueryToSettings(query, _settings);
-
-	_settings.print();
+	pipeline::settings::gridfitter_settings_t settings = _settings;
 
-	const auto result = evaluate(_settings);
+	applyQueryToSettings(query, settings);
 
-	if (result) {
-		std::cout << "Avg. Hamming: " << result.get().score << std::endl << std::endl;
-		return result.get().score;
-	} else {
-		std::cout << "Invalid results" << std::endl << std::endl;
-		return std::numeric_limits<double>::max();
-	}
+	return evaluateSettings<GridfitterResult>(
+	            query, workers, fidelity, getSettingsString(settings),
+	            [&]() { loadSettings(settings, workers); },
+	            [&](ImageIndices const& imageIndices)
+	{
+		return evaluateImages(workers, settings, imageIndices);
+	}, [](GridfitterResult const& result) { return result.score; });
 }
 
 bool GridfitterModel::checkReachability(const boost::numeric::ublas::vector<double> &)
@@ -136,7 +189,6 @@ double getMeanScore(const std::vector<GridfitterResult> &results) {
     const double sum = std::accumulate(results.begin(), results.end(), 0.,
                                        [](double& acc, GridfitterResult const& result)
     {
-        std::cout << result.score << std::endl;
         return acc + result.score;
     });
 
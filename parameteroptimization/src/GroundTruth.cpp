@@ -0,0 +1,119 @@
+#include "GroundTruth.h"
+
+#include <fstream>
+#include <iostream>
+
+#include <cereal/types/polymorphic.hpp>
+#include <cereal/archives/json.hpp>
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/vector.hpp>
+
+#include "Grid3D.h"
+
+namespace Serialization = BioTracker::Core::Serialization;
+using BioTracker::Core::TrackedObject;
+
+namespace opt {
+
+boost::filesystem::path getBinaryGroundTruthPath(const boost::filesystem::path &groundTruthPath)
+{
+    boost::filesystem::path binaryPath(groundTruthPath);
+    binaryPath.replace_extension(".tbin");
+
+    return binaryPath;
+}
+
+Serialization::Data loadGroundTruth(const boost::filesystem::path &groundTruthPath)
+{
+    namespace fs = boost::filesystem;
+
+    const fs::path binaryPath = getBinaryGroundTruthPath(groundTruthPath);
+
+    if (fs::is_regular_file(binaryPath) &&
+            (fs::last_write_time(binaryPath) >= fs::last_write_time(groundTruthPath))) {
+        try {
+            return loadBinaryGroundTruth(binaryPath);
+        } catch (cereal::Exception const& e) {
+            std::cerr << "Unable to load binary ground truth " << binaryPath.string()
+                      << ": " << e.what() << std::endl;
+        }
+    }
+
+    return loadJsonGroundTruth(groundTruthPath);
+}
+
+Serialization::Data loadJsonGroundTruth(const boost::filesystem::path &groundTruthPath)
+{
+    Serialization::Data data;
+
+    std::ifstream is(groundTruthPath.string());
+    cereal::JSONInputArchive ar(is);
+
+    // load serialized data
+    ar(data);
+
+    return data;
+}
+
+Serialization::Data loadBinaryGroundTruth(const boost::filesystem::path &binaryPath)
+{
+    Serialization::Data data;
+
+    std::ifstream is(binaryPath.string(), std::ios::binary);
+    cereal::PortableBinaryInputArchive ar(is);
+
+    ar(data);
+
+    return data;
+}
+
+GroundTruthEvaluation::ResultsByFrame getResultsByFrame(const Serialization::Data &data, size_t numFrames)
+{
+    GroundTruthEvaluation::ResultsByFrame resultsByFrame;
+
+    // one entry per frame, inserted in order at the end
+    for (size_t frameNumber = 0; frameNumber < numFrames; ++frameNumber) {
+        resultsByFrame.emplace_hint(resultsByFrame.end(), frameNumber, std::vector<GroundTruthGridSPtr>());
+    }
+
+    for (TrackedObject const& object : data.getTrackedObjects()) {
+        // TrackedObject only offers lookups by frame number, so every frame of
+        // the file up to the last frame of the object is looked up, including
+        // frames whose image is missing
+        for (size_t frameNumber = 0; frameNumber < numFrames && frameNumber <= object.getLastFrameNumber(); ++frameNumber) {
+            const std::shared_ptr<Grid3D> grid3d = object.maybeGet<Grid3D>(frameNumber);
+
+            if (!grid3d) continue;
+
+            // convert to PipelineGrid
+            const auto grid = std::make_shared<PipelineGrid>(
+                        grid3d->getCenter(), grid3d->getPixelRadius(),
+                        grid3d->getZRotation(), grid3d->getYRotation(),
+                        grid3d->getXRotation());
+            grid->setIdArray(grid3d->getIdArray());
+            grid->setSettable(grid3d->isSettable());
+            grid->setHasBeenSet(grid3d->hasBeenBitToggled() == boost::logic::tribool::true_value);
+
+            resultsByFrame[frameNumber].push_back(grid);
+        }
+    }
+
+    return resultsByFrame;
+}
+
+void writeJsonGroundTruth(const Serialization::Data &data, const boost::filesystem::path &groundTruthPath)
+{
+    std::ofstream os(groundTruthPath.string());
+    cereal::JSONOutputArchive ar(os);
+
+    ar(data);
+}
+
+void writeBinaryGroundTruth(const Serialization::Data &data, const boost::filesystem::path &binaryPath)
+{
+    std::ofstream os(binaryPath.string(), std::ios::binary);
+    cereal::PortableBinaryOutputArchive ar(os);
+
+    ar(data);
+}
+}
@@ -0,0 +1,96 @@
+#include "ImageStore.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+namespace opt {
+
+ImageStore &ImageStore::getInstance()
+{
+    static ImageStore store;
+
+    return store;
+}
+
+ImageStore::ImageStore()
+    : _numDecoded(0)
+{}
+
+ImageStore::image_ptr_t ImageStore::get(const boost::filesystem::path &imagePath)
+{
+    std::promise<image_ptr_t> decoded;
+    std::shared_future<image_ptr_t> pending;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        const auto it = _imageByPath.find(imagePath);
+        if (it != _imageByPath.end()) {
+            if (image_ptr_t image = it->second.image.lock()) {
+                return image;
+            }
+            pending = it->second.pending;
+        }
+
+        if (!pending.valid()) {
+            // the image has to be decoded, a good time to drop the entries
+            // of images that are no longer used
+            removeExpired();
+
+            _imageByPath[imagePath].pending = decoded.get_future().share();
+        }
+    }
+
+    // another request is decoding the image
+    if (pending.valid()) {
+        return pending.get();
+    }
+
+    image_ptr_t image;
+    try {
+        image = std::make_shared<const cv::Mat>(cv::imread(imagePath.string(), CV_LOAD_IMAGE_GRAYSCALE));
+    } catch (...) {
+        // waiting requests get the error, later requests decode the image again
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _imageByPath.erase(imagePath);
+        }
+
+        decoded.set_exception(std::current_exception());
+
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Entry& entry = _imageByPath[imagePath];
+        entry.image   = image;
+        entry.pending = std::shared_future<image_ptr_t>();
+
+        ++_numDecoded;
+    }
+
+    decoded.set_value(image);
+
+    return image;
+}
+
+void ImageStore::removeExpired()
+{
+    for (auto it = _imageByPath.begin(); it != _imageByPath.end();) {
+        if (it->second.image.expired() && !it->second.pending.valid()) {
+            it = _imageByPath.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ImageStore::getNumDecoded() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _numDecoded;
+}
+}
@@ -0,0 +1,95 @@
+#include "JobScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <thread>
+
+namespace opt {
+
+JobScheduler::JobScheduler(size_t numConcurrentJobs)
+    : _numConcurrentJobs(std::max<size_t>(1, numConcurrentJobs))
+    , _numRunning(0)
+    , _numFinished(0)
+    , _numFailed(0)
+{}
+
+void JobScheduler::addJob(const std::string &name, std::function<void ()> run)
+{
+    _jobs.push_back({name, run});
+}
+
+size_t JobScheduler::run()
+{
+    std::atomic<size_t> nextJobIdx(0);
+
+    auto runJobs = [&]() {
+        for (size_t jobIdx = nextJobIdx++; jobIdx < _jobs.size(); jobIdx = nextJobIdx++) {
+            runJob(jobIdx);
+        }
+    };
+
+    const size_t numThreads = std::min(_numConcurrentJobs, _jobs.size());
+
+    if (numThreads <= 1) {
+        runJobs();
+    } else {
+        std::vector<std::thread> threads;
+        for (size_t threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+            threads.emplace_back(runJobs);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    return _numFailed;
+}
+
+void JobScheduler::runJob(size_t jobIdx)
+{
+    Job const& job = _jobs[jobIdx];
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_numRunning;
+
+        std::cout << "Job " << (jobIdx + 1) << "/" << _jobs.size() << " started: " << job.name
+                  << " (" << _numRunning << " running, " << _numFinished << " finished)" << std::endl;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    bool failed = false;
+    try {
+        job.run();
+    } catch (std::exception const& e) {
+        failed = true;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::cerr << "Job " << (jobIdx + 1) << "/" << _jobs.size() << " failed: " << job.name
+                  << ": " << e.what() << std::endl;
+    } catch (...) {
+        // anything else would terminate the worker thread and all other jobs
+        failed = true;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::cerr << "Job " << (jobIdx + 1) << "/" << _jobs.size() << " failed: " << job.name
+                  << ": unknown exception" << std::endl;
+    }
+
+    const auto duration = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now() - start);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    --_numRunning;
+    ++_numFinished;
+    if (failed) ++_numFailed;
+
+    std::cout << "Job " << (jobIdx + 1) << "/" << _jobs.size() << (failed ? " aborted: " : " finished: ")
+              << job.name << " after " << duration.count() << "s"
+              << " (" << _numFinished << " of " << _jobs.size() << " finished, "
+              << _numRunning << " running)" << std::endl;
+}
+}
@@ -2,17 +2,16 @@
 
 #include "StdioHandler.h"
 
-#include <pipeline/util/ThreadPool.h>
 #include <pipeline/datastructure/Tag.h>
 
 namespace opt {
 
-LocalizerModel::LocalizerModel(bopt_params param, const multiple_path_struct_t &task,
+LocalizerModel::LocalizerModel(bopt_params param, const std::shared_ptr<const Dataset> &dataset,
+                               const ModelOptions &options,
                                const boost::optional<DeepLocalizerPaths> &deeplocalizerPaths,
                                const ParameterMaps &parameterMaps)
-    : OptimizationModel(param, task, parameterMaps, getNumDimensions())
-    , _preprocessor(std::make_unique<pipeline::Preprocessor>())
-    , _localizer(std::make_unique<pipeline::Localizer>())
+    : OptimizationModel(param, dataset, options, parameterMaps)
+    , _preprocessorCache(options.preprocessor_cache_size * 1024 * 1024)
 {
 
 	namespace settingspreprocessor = pipeline::settings::Preprocessor::Params;
@@ -29,11 +28,18 @@ LocalizerModel::LocalizerModel(bopt_params param, const multiple_path_struct_t &
         _localizerSettings.setValue(settingslocalizer::TAG_SIZE, 100u);
     }
 
-    _localizer->loadSettings(_localizerSettings);
+    _workers.resize(getNumWorkers());
+    for (Worker& worker : _workers) {
+        worker.preprocessor = std::make_unique<pipeline::Preprocessor>();
+        worker.localizer    = std::make_unique<pipeline::Localizer>();
+        worker.evaluators   = createEvaluators();
+
+        worker.localizer->loadSettings(_localizerSettings);
+    }
 }
 
-LocalizerModel::LocalizerModel(bopt_params param, const multiple_path_struct_t &task, const boost::optional<DeepLocalizerPaths> &deeplocalizerPaths)
-    : LocalizerModel(param, task, deeplocalizerPaths, getDefaultLimits())
+LocalizerModel::LocalizerModel(bopt_params param, const std::shared_ptr<const Dataset> &dataset, const ModelOptions &options, const boost::optional<DeepLocalizerPaths> &deeplocalizerPaths)
+    : LocalizerModel(param, dataset, options, deeplocalizerPaths, getDefaultLimits())
 {}
 
 OptimizationModel::ParameterMaps LocalizerModel::getDefaultLimits() {
@@ -75,7 +81,7 @@ OptimizationModel::ParameterMaps LocalizerModel::getDefaultLimits() {
 
 void LocalizerModel::applyQueryToSettings(const boost::numeric::ublas::vector<double> &query,
 										  pipeline::settings::localizer_settings_t &lsettings,
-										  pipeline::settings::preprocessor_settings_t &psettings) {
+										  pipeline::settings::preprocessor_settings_t &psettings) const {
 	{
 		using namespace pipeline::settings::Localizer;
         setValueFromQuery<int>(lsettings, Params::BINARY_THRESHOLD, query);
@@ -104,68 +110,112 @@ void LocalizerModel::applyQueryToSettings(const boost::numeric::ublas::vector<do
 boost::optional<LocalizerResult>
 LocalizerModel::evaluate(pipeline::settings::localizer_settings_t &lsettings,
                          pipeline::settings::preprocessor_settings_t &psettings) {
-    std::vector<OptimizationResult> results;
+    return evaluate(lsettings, psettings, getAllWorkers(), getAllImages());
+}
+
+boost::optional<LocalizerResult>
+LocalizerModel::evaluate(pipeline::settings::localizer_settings_t &lsettings,
+                         pipeline::settings::preprocessor_settings_t &psettings,
+                         WorkerRange workers, const ImageIndices &imageIndices) {
+    loadSettings(lsettings, psettings, workers);
 
-    for (auto const& imagesByEvaluator : _imagesByEvaluator)
+    const std::vector<OptimizationResult> results =
+            evaluateImages(workers, getSettingsHash(psettings), imageIndices);
+
+    return LocalizerResult(results, psettings, lsettings);
+}
+
+void LocalizerModel::loadSettings(const pipeline::settings::localizer_settings_t &lsettings,
+                                  const pipeline::settings::preprocessor_settings_t &psettings,
+                                  WorkerRange workers)
+{
+    // settings are loaded before dispatching, the workers only read them
+    for (size_t workerIdx = workers.first; workerIdx < workers.first + workers.count; ++workerIdx) {
+        _workers[workerIdx].preprocessor->loadSettings(psettings);
+        _workers[workerIdx].localizer->loadSettings(lsettings);
+    }
+}
+
+std::vector<OptimizationResult> LocalizerModel::evaluateImages(WorkerRange workers, size_t preprocessorSettingsHash,
+                                                               const ImageIndices &imageIndices)
+{
+    return evaluateInParallel<OptimizationResult>(
+                workers, imageIndices, [&](size_t workerIdx, ImageIndices const& chunkIndices)
     {
-        GroundTruthEvaluation* evaluator = imagesByEvaluator.first.get();
-        const std::vector<boost::filesystem::path>& imagesPaths = imagesByEvaluator.second;
+        return evaluateChunk(_workers[workerIdx], getStageTimes(workerIdx), preprocessorSettingsHash, chunkIndices);
+    });
+}
+
+std::vector<OptimizationResult> LocalizerModel::evaluateChunk(Worker &worker, StageTimes &stageTimes,
+                                                              size_t preprocessorSettingsHash,
+                                                              const ImageIndices &imageIndices)
+{
+    std::vector<OptimizationResult> results;
 
-        _preprocessor->loadSettings(psettings);
-        _localizer->loadSettings(lsettings);
+    for (size_t imageIdx : imageIndices)
+    {
+        Dataset::Image const& image = _dataset->getImage(imageIdx);
+        GroundTruthEvaluation* evaluator = worker.evaluators[image.groundTruthIdx].get();
 
-        size_t frameNumber = 0;
-        for (const boost::filesystem::path& imagePath : imagesPaths)
+        const auto imageStart = std::chrono::steady_clock::now();
+        auto start = imageStart;
+        pipeline::PreprocessorResult preprocessed = _preprocessorCache.get(
+                    imageIdx, preprocessorSettingsHash, [&]()
         {
-            cv::Mat img(_imageByPath[imagePath]);
+            cv::Mat img(_dataset->getImageData(imageIdx));
+
+            return worker.preprocessor->process(img);
+        });
+        stageTimes.add("preprocessor", start);
 
-            pipeline::PreprocessorResult preprocessed = _preprocessor->process(img);
-            taglist_t taglist = _localizer->process(std::move(preprocessed));
+        start = std::chrono::steady_clock::now();
+        taglist_t taglist = worker.localizer->process(std::move(preprocessed));
+        stageTimes.add("localizer", start);
 
-            evaluator->evaluateLocalizer(frameNumber, taglist);
+        start = std::chrono::steady_clock::now();
+        evaluator->evaluateLocalizer(image.frameNumber, taglist);
+        stageTimes.add("evaluation", start);
 
-            const auto localizerResult = evaluator->getLocalizerResults();
+        const auto localizerResult = evaluator->getLocalizerResults();
 
-            const size_t numGroundTruth    = localizerResult.taggedGridsOnFrame.size();
-            const size_t numTruePositives  = localizerResult.truePositives.size();
-            const size_t numFalsePositives = localizerResult.falsePositives.size();
+        const size_t numGroundTruth    = localizerResult.taggedGridsOnFrame.size();
+        const size_t numTruePositives  = localizerResult.truePositives.size();
+        const size_t numFalsePositives = localizerResult.falsePositives.size();
 
-            results.push_back(getOptimizationResult(numGroundTruth, numTruePositives, numFalsePositives, 2.));
+        results.push_back(getOptimizationResult(numGroundTruth, numTruePositives, numFalsePositives, 2.));
 
-            ++frameNumber;
+        evaluator->reset();
 
-            evaluator->reset();
-        }
+        stageTimes.addImage(imageStart);
     }
 
-    return LocalizerResult(results, psettings, lsettings);
+    return results;
 }
 
-double LocalizerModel::evaluateSample(const boost::numeric::ublas::vector<double> &query) {
-	applyQueryToSettings(query, _localizerSettings, _preprocessorSettings);
+double LocalizerModel::evaluateQuery(const boost::numeric::ublas::vector<double> &query, WorkerRange workers,
+                                     Fidelity fidelity) {
+	pipeline::settings::localizer_settings_t lsettings = _localizerSettings;
+	pipeline::settings::preprocessor_settings_t psettings = _preprocessorSettings;
 
-	const auto result = evaluate(_localizerSettings, _preprocessorSettings);
+	applyQueryToSettings(query, lsettings, psettings);
 
-	double score = 0.;
-	if (result) {
-        std::cout << "Recall: " << result.get().recall << std::endl;
-        std::cout << "Precision: " << result.get().precision << std::endl;
-        std::cout << "F-Score: " << result.get().fscore << std::endl << std::endl;
-		score = result.get().fscore;
-	} else {
-		std::cout << "Invalid results" << std::endl
-		          << std::endl;
-	}
+	const size_t preprocessorSettingsHash = getSettingsHash(psettings);
 
-	return (1 - score);
+	return evaluateSettings<OptimizationResult>(
+	            query, workers, fidelity, getSettingsString(lsettings) + getSettingsString(psettings),
+	            [&]() { loadSettings(lsettings, psettings, workers); },
+	            [&](ImageIndices const& imageIndices)
+	{
+		return evaluateImages(workers, preprocessorSettingsHash, imageIndices);
+	}, [](OptimizationResult const& result) { return 1 - result.fscore; });
 }
 
 bool LocalizerModel::checkReachability(const boost::numeric::ublas::vector<double> &query)
 {
-    OptimizationModel::ParameterMaps::queryIdxByParam &queryIdxByParameter = _parameterMaps.queryIdxByParameter;
+    using namespace pipeline::settings::Localizer;
 
-    return query[queryIdxByParameter[pipeline::settings::Localizer::Params::MIN_NUM_PIXELS]] <=
-            query[queryIdxByParameter[pipeline::settings::Localizer::Params::MAX_NUM_PIXELS]];
+    return _parameterMaps.getQueryValue(Params::MIN_NUM_PIXELS, query) <=
+            _parameterMaps.getQueryValue(Params::MAX_NUM_PIXELS, query);
 }
 
 size_t LocalizerModel::getNumDimensions()
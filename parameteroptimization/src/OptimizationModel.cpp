@@ -1,85 +1,464 @@
 #include "OptimizationModel.h"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <random>
+#include <tuple>
 
-#include <cereal/types/polymorphic.hpp>
-#include <cereal/archives/json.hpp>
-#include <cereal/types/vector.hpp>
-
-#include <biotracker/serialization/SerializationData.h>
+#include <bopt_state.hpp>
 
 #include <pipeline/util/GroundTruthEvaluator.h>
 
-#include "Grid3D.h"
-
-namespace Serialization = BioTracker::Core::Serialization;
-using BioTracker::Core::TrackedObject;
-
 namespace opt {
 
-OptimizationModel::OptimizationModel(bopt_params param, const multiple_path_struct_t &task,
-                                     const ParameterMaps &parameterMaps, size_t numDimensions)
-    : bayesopt::ContinuousModel(numDimensions, param)
+OptimizationModel::OptimizationModel(bopt_params param, const std::shared_ptr<const Dataset> &dataset,
+                                     const ModelOptions &options,
+                                     const ParameterMaps &parameterMaps)
+    : bayesopt::ContinuousModel(parameterMaps.getNumFreeParameters() + (options.multi_fidelity ? 1 : 0), param)
+    , _dataset(dataset)
     , _parameterMaps(parameterMaps)
+    , _options(options)
+    , _bestCost(std::numeric_limits<double>::infinity())
+    , _numEvaluations(0)
+    , _numCachedEvaluations(0)
+    , _bestReportedCost(std::numeric_limits<double>::infinity())
+    , _startTime(std::chrono::steady_clock::now())
+    , _lastProgressTime(_startTime)
+    // never more workers than threads, queries of a batch beyond the number
+    // of workers wait for a free one
+    , _numWorkers(std::max<size_t>(1, options.num_threads))
+    , _threadPool(std::make_unique<ThreadPool>(_numWorkers))
+    , _collectingBatch(false)
+    , _batchLie(0.)
+{
+    assert(parameterMaps.getNumFreeParameters() > 0);
+
+    _parameterMaps.pinConstantParameters();
+
+    for (auto const& paramLimits : _parameterMaps.limitsByParameter) {
+        if (!_parameterMaps.queryIdxByParameter.count(paramLimits.first)) {
+            std::cout << "Constant parameter: " << paramLimits.first << " = " << paramLimits.second.min << std::endl;
+        }
+    }
+
+    _stageTimesByWorker.resize(_numWorkers);
+
+    _allImages.resize(_dataset->getNumImages());
+    std::iota(_allImages.begin(), _allImages.end(), 0);
+
+    _racingOrder = _allImages;
+    std::shuffle(_racingOrder.begin(), _racingOrder.end(), std::mt19937(42));
+
+    const size_t numLowFidelityImages = std::min(_racingOrder.size(), std::max<size_t>(
+            1, static_cast<size_t>(std::ceil(options.low_fidelity_fraction * _racingOrder.size()))));
+    _lowFidelityImages.assign(_racingOrder.begin(), _racingOrder.begin() + numLowFidelityImages);
+}
+
+OptimizationModel::Fidelity OptimizationModel::getFidelity(const boost::numeric::ublas::vector<double> &query) const
+{
+    if (!_options.multi_fidelity) return Fidelity::Full;
+
+    return query[mDims - 1] >= 0.5 ? Fidelity::Full : Fidelity::Low;
+}
+
+void OptimizationModel::setTelemetrySink(const std::shared_ptr<TelemetrySink> &telemetrySink)
+{
+    _telemetrySink = telemetrySink;
+}
+
+StageTimes OptimizationModel::takeStageTimes(WorkerRange workers)
+{
+    StageTimes stageTimes;
+    for (size_t workerIdx = workers.first; workerIdx < workers.first + workers.count; ++workerIdx) {
+        stageTimes.merge(_stageTimesByWorker[workerIdx]);
+        _stageTimesByWorker[workerIdx] = StageTimes();
+    }
+    return stageTimes;
+}
+
+void OptimizationModel::recordEvaluation(const boost::numeric::ublas::vector<double> &query, Fidelity fidelity,
+                                         EvaluationRecord &record)
+{
+    record.query.assign(query.begin(), query.end());
+    record.fidelity = fidelity == Fidelity::Full ? "full" : "low";
+
+    if (_telemetrySink) {
+        _telemetrySink->write(record);
+    }
+
+    std::lock_guard<std::mutex> lock(_progressMutex);
+
+    ++_numEvaluations;
+    if (record.cached) ++_numCachedEvaluations;
+    if (fidelity == Fidelity::Full) {
+        _bestReportedCost = std::min(_bestReportedCost, record.cost);
+    }
+
+    // at most one progress line every few seconds
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _lastProgressTime < std::chrono::seconds(5)) return;
+    _lastProgressTime = now;
+
+    const double seconds = std::chrono::duration<double>(now - _startTime).count();
+
+    std::cout << "Evaluations: " << _numEvaluations << " (" << _numCachedEvaluations << " cached, "
+              << (_numEvaluations / std::max(seconds, 1e-9)) << "/s), best: " << _bestReportedCost
+              << ", last: " << record.cost << std::endl;
+}
+
+double OptimizationModel::getBestCost()
 {
+    std::lock_guard<std::mutex> lock(_bestCostMutex);
+    return _bestCost;
+}
+
+void OptimizationModel::updateBestCost(double cost)
+{
+    std::lock_guard<std::mutex> lock(_bestCostMutex);
+    _bestCost = std::min(_bestCost, cost);
+}
 
-    for (auto const& keyValuePair : task.imageFilesByGroundTruthFile)
+std::vector<std::unique_ptr<GroundTruthEvaluation>> OptimizationModel::createEvaluators() const
+{
+    std::vector<std::unique_ptr<GroundTruthEvaluation>> evaluators;
+
+    for (size_t groundTruthIdx = 0; groundTruthIdx < _dataset->getNumGroundTruthFiles(); ++groundTruthIdx) {
+        evaluators.push_back(std::make_unique<GroundTruthEvaluation>(
+                                 GroundTruthEvaluation::ResultsByFrame(_dataset->getGroundTruth(groundTruthIdx))));
+    }
+
+    return evaluators;
+}
+
+std::vector<OptimizationModel::EvaluatorSnapshot>
+OptimizationModel::createEvaluatorSnapshots(Dataset::Stage stage)
+{
+    assert(_dataset->hasTaglists(stage));
+
+    return evaluateInParallel<EvaluatorSnapshot>(
+                getAllWorkers(), getAllImages(), [&](size_t, ImageIndices const& chunkIndices)
     {
-        boost::filesystem::path groundTruthPath = keyValuePair.first;
+        std::vector<EvaluatorSnapshot> snapshots;
+
+        for (size_t imageIdx : chunkIndices) {
+            Dataset::Image const& image = _dataset->getImage(imageIdx);
+            GroundTruthEvaluation::ResultsByFrame const& groundTruth = _dataset->getGroundTruth(image.groundTruthIdx);
+
+            // the snapshot only holds the ground truth of its own frame
+            GroundTruthEvaluation::ResultsByFrame frameGroundTruth;
+            const auto it = groundTruth.find(image.frameNumber);
+            frameGroundTruth.emplace(image.frameNumber, it == groundTruth.end() ?
+                                         std::vector<GroundTruthGridSPtr>() : it->second);
+
+            auto evaluator = std::make_shared<GroundTruthEvaluation>(std::move(frameGroundTruth));
+
+            // the localizer results refer to the tags they were matched with,
+            // so they are matched with the taglist of the dataset, which is
+            // not modified and lives as long as the model
+            evaluator->evaluateLocalizer(image.frameNumber, _dataset->getTaglist(stage, imageIdx));
+
+            snapshots.push_back(std::move(evaluator));
+        }
+
+        return snapshots;
+    });
+}
+
+void OptimizationModel::optimizeInBatches(boost::numeric::ublas::vector<double> &bestPoint)
+{
+    assert(bestPoint.size() == mDims);
+
+    if (!restoreCheckpoint()) {
+        initializeInParallel();
+        saveCheckpoint();
+    }
+
+    while (mCurrentIter < mParameters.n_iterations) {
+        const size_t batchSize = std::min(_options.batch_size, mParameters.n_iterations - mCurrentIter);
+
+        // multi fidelity needs to decide on the fidelity before evaluating
+        if (batchSize > 1 || _options.multi_fidelity) {
+            stepBatch(batchSize);
+        } else {
+            stepOptimization();
+        }
+
+        saveCheckpoint();
+    }
+
+    bestPoint = _options.multi_fidelity ? getBestFullFidelityResult() : getFinalResult();
+}
+
+void OptimizationModel::stepBatch(size_t batchSize)
+{
+    bayesopt::BOptState state;
+    saveOptimization(state);
+
+    // constant liar: every pending query is assumed to be as good as the best
+    // sample so far. BayesOpt adds the lie to the surrogate, so the next
+    // proposal of the batch moves away from the pending ones.
+    _batchLie = *std::min_element(state.mY.begin(), state.mY.end());
+    _batchQueries.clear();
+
+    _collectingBatch = true;
+    for (size_t i = 0; i < batchSize; ++i) {
+        stepOptimization();
+    }
+    _collectingBatch = false;
+
+    std::vector<boost::numeric::ublas::vector<double>> queries;
+    std::vector<double> scores;
+
+    if (_options.multi_fidelity) {
+        double bestLowFidelityScore = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < state.mX.size(); ++i) {
+            if (getFidelity(state.mX[i]) == Fidelity::Low) {
+                bestLowFidelityScore = std::min(bestLowFidelityScore, state.mY[i]);
+            }
+        }
+
+        std::tie(queries, scores) = evaluateMultiFidelity(_batchQueries, bestLowFidelityScore);
+    } else {
+        queries = _batchQueries;
+        scores = evaluateQueries(queries);
+    }
 
-        Serialization::Data data;
-        {
-            std::ifstream is(groundTruthPath.string());
-            cereal::JSONInputArchive ar(is);
+    // replace the lies with the actual scores. the model uses the default
+    // bounding box, i.e. queries are already normalized.
+    const size_t numSamples = state.mY.size();
+    state.mY.resize(numSamples + scores.size(), true);
+    for (size_t i = 0; i < scores.size(); ++i) {
+        state.mX.push_back(queries[i]);
+        state.mY[numSamples + i] = scores[i];
+    }
+    state.mCurrentIter += batchSize;
+
+    restoreOptimization(state);
+}
+
+std::pair<std::vector<boost::numeric::ublas::vector<double>>, std::vector<double>>
+OptimizationModel::evaluateMultiFidelity(std::vector<boost::numeric::ublas::vector<double>> queries,
+                                         double bestLowFidelityScore)
+{
+    for (auto& query : queries) {
+        query[mDims - 1] = 0.;
+    }
+
+    std::vector<double> scores = evaluateQueries(queries);
+
+    for (double score : scores) {
+        bestLowFidelityScore = std::min(bestLowFidelityScore, score);
+    }
+
+    std::vector<boost::numeric::ublas::vector<double>> promisingQueries;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (scores[i] <= bestLowFidelityScore + _options.multi_fidelity_threshold) {
+            promisingQueries.push_back(queries[i]);
+            promisingQueries.back()[mDims - 1] = 1.;
+        }
+    }
+
+    if (!promisingQueries.empty()) {
+        const std::vector<double> fullScores = evaluateQueries(promisingQueries);
+
+        queries.insert(queries.end(), promisingQueries.begin(), promisingQueries.end());
+        scores.insert(scores.end(), fullScores.begin(), fullScores.end());
+    }
 
-            // load serialized data into member .data
-            ar(data);
+    return std::make_pair(queries, scores);
+}
+
+boost::numeric::ublas::vector<double> OptimizationModel::getBestFullFidelityResult()
+{
+    bayesopt::BOptState state;
+    saveOptimization(state);
+
+    boost::optional<size_t> bestIdx;
+    for (size_t i = 0; i < state.mX.size(); ++i) {
+        if (getFidelity(state.mX[i]) == Fidelity::Full && (!bestIdx || state.mY[i] < state.mY[bestIdx.get()])) {
+            bestIdx = i;
         }
+    }
 
-        for (boost::filesystem::path const& imagePath : keyValuePair.second)
-        {
-            const cv::Mat image = cv::imread(imagePath.string(), CV_LOAD_IMAGE_GRAYSCALE);
+    if (!bestIdx) {
+        std::cerr << "No query has been evaluated on full fidelity" << std::endl;
+        return getFinalResult();
+    }
+
+    return state.mX[bestIdx.get()];
+}
+
+void OptimizationModel::setCheckpointPath(const boost::filesystem::path &checkpointPath)
+{
+    _checkpointPath = checkpointPath;
+}
+
+bool OptimizationModel::restoreCheckpoint()
+{
+    if (!_checkpointPath || !boost::filesystem::is_regular_file(_checkpointPath.get())) {
+        return false;
+    }
+
+    bayesopt::BOptState state;
+    if (!state.loadFromFile(_checkpointPath.get().string(), mParameters)) {
+        std::cerr << "Unable to load checkpoint: " << _checkpointPath.get().string() << std::endl;
+        return false;
+    }
+
+    std::cout << "Resuming from checkpoint: " << _checkpointPath.get().string()
+              << " (" << state.mY.size() << " samples, iteration " << state.mCurrentIter << ")" << std::endl;
+
+    restoreOptimization(state);
 
-            _imageByPath.insert({imagePath, image});
+    // aborted queries are always worse than the best full evaluation at that
+    // time, so the minimum is a fully evaluated query
+    for (size_t i = 0; i < state.mX.size(); ++i) {
+        if (getFidelity(state.mX[i]) == Fidelity::Full) {
+            updateBestCost(state.mY[i]);
         }
+    }
+
+    return true;
+}
 
-        GroundTruthEvaluation::ResultsByFrame resultsByFrame;
-        for (TrackedObject const& object : data.getTrackedObjects()) {
-            for (size_t frameNumber = 0; frameNumber <= object.getLastFrameNumber(); ++frameNumber) {
-                std::vector<GroundTruthGridSPtr>& results = resultsByFrame[frameNumber];
+void OptimizationModel::saveCheckpoint()
+{
+    if (!_checkpointPath) return;
 
-                const std::shared_ptr<Grid3D> grid3d = object.maybeGet<Grid3D>(frameNumber);
+    bayesopt::BOptState state;
+    saveOptimization(state);
 
-                if (!grid3d) continue;
+    // write to a temporary file first, an interrupted write must not destroy
+    // the previous checkpoint
+    const boost::filesystem::path tmpPath = _checkpointPath.get().string() + ".tmp";
+    if (state.saveToFile(tmpPath.string())) {
+        boost::filesystem::rename(tmpPath, _checkpointPath.get());
+    } else {
+        std::cerr << "Unable to write checkpoint: " << _checkpointPath.get().string() << std::endl;
+    }
+}
 
-                // convert to PipelineGrid
-                const auto grid = std::make_shared<PipelineGrid>(
-                            grid3d->getCenter(), grid3d->getPixelRadius(),
-                            grid3d->getZRotation(), grid3d->getYRotation(),
-                            grid3d->getXRotation());
-                grid->setIdArray(grid3d->getIdArray());
-                grid->setSettable(grid3d->isSettable());
-                grid->setHasBeenSet(grid3d->hasBeenBitToggled() == boost::logic::tribool::true_value);
+void OptimizationModel::initializeInParallel()
+{
+    const size_t numSamples = mParameters.n_init_samples;
+    assert(numSamples > 0);
 
-                // insert in set
-                if (grid) {
-                    results.push_back(grid);
-                }
+    boost::numeric::ublas::matrix<double> xPoints(numSamples, mDims);
+    generateInitialPoints(xPoints);
+
+    std::vector<boost::numeric::ublas::vector<double>> queries;
+    for (size_t i = 0; i < numSamples; ++i) {
+        queries.push_back(boost::numeric::ublas::row(xPoints, i));
+
+        // the initial design covers both fidelities
+        if (_options.multi_fidelity) {
+            queries.back()[mDims - 1] = std::round(queries.back()[mDims - 1]);
+        }
+    }
+
+    const std::vector<double> scores = evaluateQueries(queries);
+
+    bayesopt::BOptState state;
+    state.mCurrentIter  = 0;
+    state.mCounterStuck = 0;
+    state.mYPrev        = 0.;
+    state.mParameters   = mParameters;
+    state.mX            = queries;
+    state.mY.resize(scores.size());
+    std::copy(scores.begin(), scores.end(), state.mY.begin());
+
+    restoreOptimization(state);
+}
+
+std::vector<double> OptimizationModel::evaluateQueries(const std::vector<boost::numeric::ublas::vector<double>> &queries)
+{
+    const size_t numRanges = std::min(queries.size(), _numWorkers);
+
+    std::vector<double> scores(queries.size());
+    std::atomic<size_t> nextQueryIdx(0);
+
+    std::vector<std::future<void>> futures;
+    for (size_t rangeIdx = 0; rangeIdx < numRanges; ++rangeIdx) {
+        const size_t firstWorker = (rangeIdx * _numWorkers) / numRanges;
+        const size_t endWorker   = ((rangeIdx + 1) * _numWorkers) / numRanges;
+        const WorkerRange workers{firstWorker, endWorker - firstWorker};
+
+        // not run on the thread pool, because evaluateQuery itself waits for
+        // tasks on the pool
+        futures.push_back(std::async(std::launch::async, [&, workers]() {
+            for (size_t queryIdx = nextQueryIdx++; queryIdx < queries.size(); queryIdx = nextQueryIdx++) {
+                scores[queryIdx] = evaluateQuery(queries[queryIdx], workers, getFidelity(queries[queryIdx]));
             }
+        }));
+    }
+
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    return scores;
+}
+
+double OptimizationModel::evaluateSample(const boost::numeric::ublas::vector<double> &query)
+{
+    if (_collectingBatch) {
+        _batchQueries.push_back(query);
+        return _batchLie;
+    }
+
+    return evaluateQuery(query, getAllWorkers(), getFidelity(query));
+}
+
+size_t OptimizationModel::ParameterMaps::getNumFreeParameters() const
+{
+    return std::count_if(limitsByParameter.begin(), limitsByParameter.end(),
+                         [](std::pair<const std::string, limits_t> const& paramLimits)
+    {
+        return paramLimits.second.min != paramLimits.second.max;
+    });
+}
+
+void OptimizationModel::ParameterMaps::pinConstantParameters()
+{
+    std::vector<std::string> paramsByQueryIdx(queryIdxByParameter.size());
+    for (auto const& paramIdx : queryIdxByParameter) {
+        assert(paramIdx.second < paramsByQueryIdx.size());
+        paramsByQueryIdx[paramIdx.second] = paramIdx.first;
+    }
+
+    queryIdxByParameter.clear();
+    for (std::string const& param : paramsByQueryIdx) {
+        limits_t const& limits = limitsByParameter.at(param);
+
+        if (limits.min != limits.max) {
+            const size_t queryIdx = queryIdxByParameter.size();
+            queryIdxByParameter[param] = queryIdx;
         }
+    }
+}
 
-        _imagesByEvaluator.insert(std::make_pair(
-                               std::make_unique<GroundTruthEvaluation>(std::move(resultsByFrame)),
-                               keyValuePair.second));
+double OptimizationModel::ParameterMaps::getQueryValue(const std::string &param, const boost::numeric::ublas::vector<double> &query) const
+{
+    const auto it = queryIdxByParameter.find(param);
+
+    if (it == queryIdxByParameter.end()) {
+        return 0.;
     }
+
+    return query[it->second];
 }
 
 void OptimizationModel::addLimitToParameter(const std::string &param, limits_t limits,
                                             ParameterMaps& parameterMaps)
 {
     if (!parameterMaps.limitsByParameter.count(param)) {
+        // operator[] inserts before the right hand side is evaluated, the
+        // index has to be taken first
+        const size_t queryIdx = parameterMaps.queryIdxByParameter.size();
+
         parameterMaps.limitsByParameter[param] = limits;
-        parameterMaps.queryIdxByParameter[param] = parameterMaps.queryIdxByParameter.size() - 1;
+        parameterMaps.queryIdxByParameter[param] = queryIdx;
     }
 }
 
@@ -87,7 +466,6 @@ double getMeanFscore(const std::vector<OptimizationResult> &results) {
     const double sum = std::accumulate(results.begin(), results.end(), 0.,
                                        [](double& acc, OptimizationResult const& result)
     {
-        std::cout << result.fscore << std::endl;
         return acc + result.fscore;
     });
 
@@ -0,0 +1,89 @@
+#include "PreprocessorCache.h"
+
+#include <iostream>
+
+namespace opt {
+
+namespace {
+size_t getMatBytes(cv::Mat const& mat) {
+    return mat.total() * mat.elemSize();
+}
+
+size_t getResultBytes(pipeline::PreprocessorResult const& result) {
+    return getMatBytes(result.originalImage) + getMatBytes(result.preprocessedImage);
+}
+}
+
+PreprocessorCache::PreprocessorCache(size_t maxBytes)
+    : _maxBytes(maxBytes)
+    , _numBytes(0)
+    , _numHits(0)
+    , _numMisses(0)
+{}
+
+pipeline::PreprocessorResult PreprocessorCache::get(size_t imageId, size_t settingsHash,
+                                                    const std::function<pipeline::PreprocessorResult ()> &preprocess)
+{
+    const key_t key(imageId, settingsHash);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        const auto it = _entries.find(key);
+        if (it != _entries.end()) {
+            ++_numHits;
+            return it->second.result;
+        }
+    }
+
+    ++_numMisses;
+
+    // preprocess without holding the lock. concurrent queries of a batch may
+    // preprocess the same image with the same settings, only the first result
+    // is stored.
+    pipeline::PreprocessorResult result = preprocess();
+    const size_t numBytes = getResultBytes(result);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        return it->second.result;
+    }
+
+    for (auto it = _entries.begin(); (_numBytes + numBytes > _maxBytes) && (it != _entries.end());) {
+        if (it->first.second != settingsHash) {
+            _numBytes -= it->second.numBytes;
+            it = _entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (_numBytes + numBytes <= _maxBytes) {
+        if (_entries.insert({key, {result, numBytes}}).second) {
+            _numBytes += numBytes;
+        }
+    }
+
+    return result;
+}
+
+size_t PreprocessorCache::getNumBytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _numBytes;
+}
+
+void PreprocessorCache::print() const
+{
+    const size_t numRequests = _numHits + _numMisses;
+
+    std::cout << "Preprocessor cache: " << _numHits << " hits, " << _numMisses << " misses";
+    if (numRequests) {
+        std::cout << " (hit rate " << (100. * _numHits) / numRequests << "%)";
+    }
+    std::cout << ", " << getNumBytes() / (1024 * 1024) << " MB used" << std::endl;
+}
+}
@@ -0,0 +1,43 @@
+#include "ScoreCache.h"
+
+#include <iostream>
+
+namespace opt {
+
+ScoreCache::ScoreCache()
+    : _numHits(0)
+    , _numMisses(0)
+{}
+
+boost::optional<double> ScoreCache::get(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto it = _scoreBySettings.find(key);
+    if (it == _scoreBySettings.end()) {
+        ++_numMisses;
+        return boost::optional<double>();
+    }
+
+    ++_numHits;
+    return it->second;
+}
+
+void ScoreCache::insert(const std::string &key, double score)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _scoreBySettings[key] = score;
+}
+
+void ScoreCache::print() const
+{
+    const size_t numRequests = _numHits + _numMisses;
+
+    std::cout << "Score cache: " << _numHits << " hits, " << _numMisses << " misses";
+    if (numRequests) {
+        std::cout << " (hit rate " << (100. * _numHits) / numRequests << "%)";
+    }
+    std::cout << std::endl;
+}
+}
@@ -1,52 +1,68 @@
 #include "StdioHandler.h"
 
+#include <cstdio>
+#include <iostream>
+
 
 StdioHandler::StdioHandler(StdioHandler::Stream stream, std::function<void (const char *)> callback)
-	:streamid(static_cast<int>(stream))
+	: streamid(static_cast<int>(stream))
+	, callback(callback)
 {
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(nullptr);
+
 	origfd = dup(streamid);
 
 	pipe(pipefd); // create pipe
-	pid = fork(); //spawn a child process to handle output of pipe
-	if (pid == 0)
-	{
-		char line[256];
-		FILE* output;
+	reader = std::thread(&StdioHandler::readLines, this);
 
-		close(pipefd[1]);
-		output = fdopen(pipefd[0], "r");
-		if (output)
-		{
-			while(fgets(line, sizeof(line), output))
-			{
-
-				int n = strlen(line);
-				if (n > 0)
-					if (line[n-1] == '\n') line[n-1] = 0;
-				callback(line);
-			}
-			fclose(output);
-		}
-		abort();
-	} else {
-		// connect input of pipe to
-		close(pipefd[0]);
-		dup2(pipefd[1], streamid);
-	}
+	// connect input of pipe to the stream
+	dup2(pipefd[1], streamid);
 }
 
 StdioHandler::~StdioHandler()
 {
-	int status;
-
-	usleep(10000);
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(nullptr);
 
+	// restore the stream, the reader sees the end of the pipe once the last
+	// descriptor of its write end is closed
+	dup2(origfd, streamid);
+	close(origfd);
 	close(pipefd[1]);
-	kill(pid,SIGINT);
 
-	waitpid(pid, &status, 0);
+	reader.join();
+	close(pipefd[0]);
+}
 
-	dup2(origfd, streamid);
+void StdioHandler::readLines()
+{
+	std::string buffer;
+	char chunk[4096];
+
+	while (true)
+	{
+		const ssize_t n = read(pipefd[0], chunk, sizeof(chunk));
+		if (n <= 0) break;
+
+		buffer.append(chunk, static_cast<size_t>(n));
+
+		size_t lineBegin = 0;
+		for (size_t lineEnd = buffer.find('\n'); lineEnd != std::string::npos; lineEnd = buffer.find('\n', lineBegin))
+		{
+			buffer[lineEnd] = 0;
+			callback(buffer.c_str() + lineBegin);
+			lineBegin = lineEnd + 1;
+		}
+		buffer.erase(0, lineBegin);
+	}
+
+	if (!buffer.empty())
+	{
+		callback(buffer.c_str());
+	}
 }
 
 
@@ -0,0 +1,146 @@
+#include "TaglistStore.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <pipeline/datastructure/serialization.hpp>
+#include <pipeline/datastructure/Tag.h>
+
+namespace opt {
+
+namespace {
+// boost::filesystem::path is not serializable, the images are stored by their path strings
+typedef std::vector<std::pair<std::string, std::vector<pipeline::Tag>>> stored_taglists_t;
+
+uint64_t getFnv1aHash(std::string const& data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+}
+
+boost::filesystem::path getTaglistPath(const boost::filesystem::path &folder, const std::string &stage,
+                                       const std::string &upstreamSettings)
+{
+    std::stringstream ss;
+    ss << "taglists_" << stage << "_" << std::hex << std::setw(16) << std::setfill('0')
+       << getFnv1aHash(upstreamSettings) << ".bin";
+
+    return folder / ss.str();
+}
+
+boost::optional<std::vector<Dataset::Taglist>> loadTaglists(const boost::filesystem::path &taglistPath,
+                                                            const std::string &upstreamSettings,
+                                                            const Dataset &dataset)
+{
+    if (!boost::filesystem::is_regular_file(taglistPath)) {
+        return boost::optional<std::vector<Dataset::Taglist>>();
+    }
+
+    std::string storedSettings;
+    stored_taglists_t storedTaglists;
+    try {
+        std::ifstream is(taglistPath.string(), std::ios::binary);
+        boost::archive::binary_iarchive ar(is);
+
+        ar >> storedSettings;
+        if (storedSettings != upstreamSettings) {
+            std::cerr << "Taglists " << taglistPath.string() << " were generated with other settings" << std::endl;
+
+            return boost::optional<std::vector<Dataset::Taglist>>();
+        }
+
+        ar >> storedTaglists;
+    } catch (boost::archive::archive_exception const& e) {
+        std::cerr << "Unable to load taglists " << taglistPath.string() << ": " << e.what() << std::endl;
+
+        return boost::optional<std::vector<Dataset::Taglist>>();
+    }
+
+    std::map<boost::filesystem::path, size_t> storedIdxByImage;
+    for (size_t storedIdx = 0; storedIdx < storedTaglists.size(); ++storedIdx) {
+        storedIdxByImage.insert({storedTaglists[storedIdx].first, storedIdx});
+    }
+
+    std::vector<Dataset::Taglist> taglists;
+    taglists.reserve(dataset.getNumImages());
+    for (Dataset::Image const& image : dataset.getImages()) {
+        const auto it = storedIdxByImage.find(image.path);
+        if (it == storedIdxByImage.end()) {
+            return boost::optional<std::vector<Dataset::Taglist>>();
+        }
+
+        taglists.push_back(storedTaglists[it->second].second);
+    }
+
+    return taglists;
+}
+
+void saveTaglists(const Dataset &dataset, Dataset::Stage stage, const std::string &upstreamSettings,
+                  const boost::filesystem::path &taglistPath)
+{
+    stored_taglists_t storedTaglists;
+    for (size_t imageIdx = 0; imageIdx < dataset.getNumImages(); ++imageIdx) {
+        storedTaglists.emplace_back(dataset.getImage(imageIdx).path.string(), dataset.getTaglist(stage, imageIdx));
+    }
+
+    std::ofstream os(taglistPath.string(), std::ios::binary);
+    boost::archive::binary_oarchive ar(os);
+
+    ar << upstreamSettings;
+    ar << storedTaglists;
+}
+
+std::vector<Dataset::Taglist> computeLocalizerTaglists(const Dataset &dataset,
+                                                       const pipeline::settings::preprocessor_settings_t &psettings,
+                                                       const pipeline::settings::localizer_settings_t &lsettings)
+{
+    pipeline::Preprocessor preprocessor;
+    preprocessor.loadSettings(psettings);
+    pipeline::Localizer localizer;
+    localizer.loadSettings(lsettings);
+
+    std::vector<Dataset::Taglist> taglists;
+    taglists.reserve(dataset.getNumImages());
+    for (size_t imageIdx = 0; imageIdx < dataset.getNumImages(); ++imageIdx) {
+        cv::Mat image(dataset.getImageData(imageIdx));
+        pipeline::PreprocessorResult preprocessed = preprocessor.process(image);
+
+        taglists.push_back(localizer.process(std::move(preprocessed)));
+    }
+
+    return taglists;
+}
+
+std::vector<Dataset::Taglist> computeEllipseFitterTaglists(const Dataset &dataset,
+                                                           const pipeline::settings::preprocessor_settings_t &psettings,
+                                                           const pipeline::settings::localizer_settings_t &lsettings,
+                                                           const pipeline::settings::ellipsefitter_settings_t &esettings)
+{
+    pipeline::EllipseFitter ellipseFitter;
+    ellipseFitter.loadSettings(esettings);
+
+    std::vector<Dataset::Taglist> taglists = computeLocalizerTaglists(dataset, psettings, lsettings);
+    for (Dataset::Taglist& taglist : taglists) {
+        taglist = ellipseFitter.process(std::move(taglist));
+        taglist.erase(std::remove_if(taglist.begin(), taglist.end(),
+                                     [](pipeline::Tag const& tag) { return tag.getCandidatesConst().empty(); }),
+                      taglist.end());
+    }
+
+    return taglists;
+}
+}
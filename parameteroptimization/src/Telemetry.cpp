@@ -0,0 +1,93 @@
+#include "Telemetry.h"
+
+#include <sstream>
+
+namespace opt {
+
+namespace {
+const size_t flushInterval = 64;
+
+// quotes a CSV field
+std::string quote(std::string const& field) {
+    std::string quoted = "\"";
+    for (char c : field) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+}
+
+void StageTimes::add(const std::string &stage, std::chrono::steady_clock::time_point start)
+{
+    milliseconds[stage] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void StageTimes::addImage(std::chrono::steady_clock::time_point start)
+{
+    imageMilliseconds.push_back(
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void StageTimes::merge(const StageTimes &other)
+{
+    for (auto const& stageTime : other.milliseconds) {
+        milliseconds[stageTime.first] += stageTime.second;
+    }
+
+    imageMilliseconds.insert(imageMilliseconds.end(), other.imageMilliseconds.begin(), other.imageMilliseconds.end());
+}
+
+CsvTelemetrySink::CsvTelemetrySink(const boost::filesystem::path &path)
+    : _numRecords(0)
+{
+    // a resumed run appends to the existing trace
+    const bool exists = boost::filesystem::is_regular_file(path) && boost::filesystem::file_size(path) > 0;
+
+    _file.open(path.string(), std::ios::app);
+
+    if (!exists) {
+        _file << "fidelity,cached,cost,duration_ms,stage_times_ms,query,image_costs,settings\n";
+    }
+}
+
+CsvTelemetrySink::~CsvTelemetrySink()
+{
+    _file.flush();
+}
+
+void CsvTelemetrySink::write(const EvaluationRecord &record)
+{
+    std::stringstream line;
+
+    line << record.fidelity << ',' << record.cached << ',' << record.cost << ',' << record.duration << ',';
+
+    std::stringstream stageTimes;
+    for (auto const& stageTime : record.stageTimes.milliseconds) {
+        stageTimes << (stageTimes.tellp() > 0 ? " " : "") << stageTime.first << '=' << stageTime.second;
+    }
+    line << quote(stageTimes.str()) << ',';
+
+    std::stringstream query;
+    for (double value : record.query) {
+        query << (query.tellp() > 0 ? " " : "") << value;
+    }
+    line << quote(query.str()) << ',';
+
+    std::stringstream imageCosts;
+    for (auto const& imageCost : record.imageCosts) {
+        imageCosts << (imageCosts.tellp() > 0 ? " " : "") << imageCost.first << ':' << imageCost.second;
+    }
+    line << quote(imageCosts.str()) << ',';
+
+    line << quote(record.settings) << '\n';
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _file << line.str();
+
+    if (++_numRecords % flushInterval == 0) {
+        _file.flush();
+    }
+}
+}
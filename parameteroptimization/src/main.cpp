@@ -1,18 +1,24 @@
 #include "main.h"
 
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <set>
+
 #include <boost/log/trivial.hpp>
 #include <boost/program_options.hpp>
 
 //#include "source/utility/MeasureTimeRAII.h"
 
+#include "AsyncLogger.h"
+#include "Dataset.h"
 #include "LocalizerModel.h"
 #include "EllipseFitterModel.h"
 #include "GridFitterModel.h"
+#include "GroundTruth.h"
+#include "JobScheduler.h"
 #include "StdioHandler.h"
-
-#include <cereal/types/polymorphic.hpp>
-#include <cereal/archives/json.hpp>
-#include <cereal/types/vector.hpp>
+#include "TaglistStore.h"
 
 #include <biotracker/serialization/SerializationData.h>
 
@@ -31,6 +37,17 @@ boost::optional<CommandLineOptions> getCommandLineOptions(int argc, char **argv)
 			("n_iterations", po::value<size_t>()->default_value(500))
             ("n_iter_relearn", po::value<size_t>()->default_value(25))
             ("optimize_mean", po::value<bool>()->default_value(false), "optimize mean of scores for all files")
+            ("num_jobs", po::value<size_t>()->default_value(1), "number of folders optimized concurrently, shares num_threads and preprocessor_cache_mb (every job keeps the images of its folder decoded in addition)")
+            ("num_threads", po::value<size_t>()->default_value(getDefaultNumThreads()), "number of worker threads")
+            ("batch_size", po::value<size_t>()->default_value(1), "number of queries evaluated concurrently per iteration")
+            ("preprocessor_cache_mb", po::value<size_t>()->default_value(2048), "memory limit of the preprocessor cache, split between concurrent jobs (decoded images are not included)")
+            ("racing", po::value<bool>()->default_value(false), "abort evaluations that can not beat the best query so far")
+            ("racing_confidence", po::value<double>()->default_value(2.), "width of the confidence interval used for racing (in standard errors)")
+            ("racing_min_images", po::value<size_t>()->default_value(8), "number of images evaluated before a query can be aborted")
+            ("multi_fidelity", po::value<bool>()->default_value(false), "evaluate on a subset of the images first, promising queries on all images")
+            ("low_fidelity_fraction", po::value<double>()->default_value(0.25), "share of the images used by low fidelity evaluations")
+            ("multi_fidelity_threshold", po::value<double>()->default_value(0.02), "maximum distance to the best low fidelity score of promising queries")
+            ("resume", po::value<std::string>(), "continue the interrupted run in the given output folder (when optimizing several folders, only the folder of this run is resumed)")
             ("deeplocalizer_model_path", po::value<std::string>())
             ("deeplocalizer_param_path", po::value<std::string>());
 
@@ -55,20 +72,28 @@ boost::optional<CommandLineOptions> getCommandLineOptions(int argc, char **argv)
                                vm["deeplocalizer_param_path"].as<std::string>() };
     }
 
+    boost::optional<std::string> resume;
+    if (vm.count("resume")) {
+        resume = vm["resume"].as<std::string>();
+    }
+
 	CommandLineOptions options{vm["data"].as<std::string>(), vm["n_init_samples"].as<size_t>(),
                                vm["n_iterations"].as<size_t>(), vm["n_iter_relearn"].as<size_t>(),
-                               deeplocalizerPaths, vm["optimize_mean"].as<bool>()};
+                               deeplocalizerPaths, vm["optimize_mean"].as<bool>(),
+                               vm["num_jobs"].as<size_t>(), vm["num_threads"].as<size_t>(), vm["batch_size"].as<size_t>(),
+                               vm["preprocessor_cache_mb"].as<size_t>(), vm["racing"].as<bool>(),
+                               vm["racing_confidence"].as<double>(), vm["racing_min_images"].as<size_t>(),
+                               vm["multi_fidelity"].as<bool>(), vm["low_fidelity_fraction"].as<double>(),
+                               vm["multi_fidelity_threshold"].as<double>(), resume};
 
 	return options;
 }
 
-multiple_path_struct_t getTasks(boost::filesystem::path dataFolder) {
+multiple_path_struct_t getTasks(boost::filesystem::path dataFolder,
+                                DatasetManifest::ImageFilesByGroundTruthFile const& imageFilesByGroundTruthFile,
+                                boost::optional<boost::filesystem::path> const& resumeFolder) {
 	namespace fs = boost::filesystem;
 
-	std::set<fs::path> files;
-    std::copy(fs::recursive_directory_iterator(dataFolder), fs::recursive_directory_iterator(),
-	          std::inserter(files, files.begin()));
-
 	auto addOptionalFile = [](fs::path path, boost::optional<fs::path>& optional) {
 		if (fs::is_regular_file(path)) {
 			optional = path;
@@ -78,46 +103,15 @@ multiple_path_struct_t getTasks(boost::filesystem::path dataFolder) {
 
     multiple_path_struct_t pstruct;
     pstruct.outputFolder = dataFolder;
+    pstruct.imageFilesByGroundTruthFile = imageFilesByGroundTruthFile;
 
-    for (const fs::path entry : files) {
-
-		if (fs::is_regular_file(entry)) {
-
-            if (entry.extension() == ".tdat") {
-				fs::path groundTruthPath(entry);
-
-				if (fs::is_regular_file(groundTruthPath)) {
-                    Serialization::Data data;
-                    {
-                        std::ifstream is(groundTruthPath.string());
-                        cereal::JSONInputArchive ar(is);
+    const bool resume = resumeFolder && isRunFolderOf(resumeFolder.get(), dataFolder);
 
-                        // load serialized data
-                        ar(data);
-                    }
-
-                    std::vector<std::string> const& fileNames = data.getFilenames();
-                    std::vector<fs::path> filePaths;
-
-                    for (std::string const& path : fileNames) {
-                        fs::path imagePath = groundTruthPath.parent_path() / path;
-                        imagePath.replace_extension(".jpeg");
-
-                        if (fs::is_regular_file(imagePath)) {
-                            filePaths.push_back(imagePath);
-                        }
-                    }
+    const fs::path folder = resume ? resumeFolder.get() : dataFolder / getDateTime();
 
-                    pstruct.imageFilesByGroundTruthFile.insert({groundTruthPath, filePaths});
-                }
-            }
-        }
-    }
-
-    const fs::path folder = dataFolder / getDateTime();
-
-    if (fs::create_directory(folder)) {
+    if (resume || fs::create_directory(folder)) {
             pstruct.logfile = folder / "output.log";
+            pstruct.checkpointFolder = folder;
 
             addOptionalFile(dataFolder / "psettings.json", pstruct.preprocessorSettings);
             addOptionalFile(dataFolder / "lsettings.json", pstruct.localizerSettings);
@@ -132,6 +126,10 @@ multiple_path_struct_t getTasks(boost::filesystem::path dataFolder) {
     return pstruct;
 }
 
+bool isRunFolderOf(const boost::filesystem::path &runFolder, const boost::filesystem::path &dataFolder) {
+    return boost::filesystem::equivalent(runFolder.parent_path(), dataFolder);
+}
+
 bopt_params getBoptParams(CommandLineOptions const &options) {
 	bopt_params params = initialize_parameters_to_default();
 
@@ -145,29 +143,70 @@ bopt_params getBoptParams(CommandLineOptions const &options) {
 	return params;
 }
 
+ModelOptions getModelOptions(CommandLineOptions const &options) {
+	ModelOptions modelOptions;
+
+	modelOptions.num_threads = std::max<size_t>(1, options.num_threads);
+	modelOptions.batch_size = std::max<size_t>(1, options.batch_size);
+	modelOptions.preprocessor_cache_size = options.preprocessor_cache_mb;
+	modelOptions.racing = options.racing;
+	modelOptions.racing_confidence = options.racing_confidence;
+	modelOptions.racing_min_images = std::max<size_t>(1, options.racing_min_images);
+	modelOptions.multi_fidelity = options.multi_fidelity;
+	modelOptions.low_fidelity_fraction = std::min(1., std::max(0., options.low_fidelity_fraction));
+	modelOptions.multi_fidelity_threshold = options.multi_fidelity_threshold;
+
+	return modelOptions;
+}
+
 void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOptions &options,
-						const bopt_params &params)
+						const bopt_params &params, bool captureOutput)
 {
-	std::ofstream logging(task.logfile.string());
-
-	// capture BayesOpt logging output
-	StdErrHandler err([&](const char* line){
-		std::cerr << line << std::endl;
-		logging << getDateTime() << " - ERROR: " << line << std::endl;
-	});
-	StdOutHandler out([&](const char* line){
-		std::cout << line << std::endl;
-		logging << getDateTime() << " - INFO: " << line << std::endl;
-	});
+	const ModelOptions modelOptions = getModelOptions(options);
+
+	// the ground truth and the decoded images are shared by all stages
+	const std::shared_ptr<Dataset> dataset = std::make_shared<Dataset>(task);
+
+	// capture BayesOpt logging output. the log file is appended to, a resumed
+	// run continues the log of the interrupted one.
+	std::unique_ptr<AsyncLogger> logger;
+	std::unique_ptr<StdErrHandler> err;
+	std::unique_ptr<StdOutHandler> out;
+	if (captureOutput) {
+		logger = std::make_unique<AsyncLogger>(task.logfile);
+		err = std::make_unique<StdErrHandler>([&](const char* line){
+			logger->log(AsyncLogger::Level::Error, line);
+		});
+		out = std::make_unique<StdOutHandler>([&](const char* line){
+			logger->log(AsyncLogger::Level::Info, line);
+		});
+	}
+
+	// finished stages are not optimized again, their settings files in the
+	// output folder are loaded instead (see getTasks)
+	auto setCurrentStage = [&](std::string const& stage) {
+		std::cout << "Stage " << stage << ": " << task.outputFolder.string() << std::endl;
+	};
+
+	auto getCheckpointPath = [&](std::string const& stage) {
+		return task.checkpointFolder / (stage + ".checkpoint");
+	};
+
+	auto getTelemetrySink = [&](std::string const& stage) {
+		return std::make_shared<CsvTelemetrySink>(task.checkpointFolder / (stage + "_evaluations.csv"));
+	};
 
 	auto optimizeLocalizer = [&]() {
         // TODO!
         //Util::MeasureTimeRAII measureTime;
 
-        LocalizerModel model(params, task, options.deeplocalizer_paths);
+        LocalizerModel model(params, dataset, modelOptions, options.deeplocalizer_paths);
+        model.setCheckpointPath(getCheckpointPath("localizer"));
+        model.setTelemetrySink(getTelemetrySink("localizer"));
+        setCurrentStage("localizer");
 
-		boost::numeric::ublas::vector<double> bestPoint(model.getNumDimensions());
-		model.optimize(bestPoint);
+		boost::numeric::ublas::vector<double> bestPoint(model.getNumQueryDimensions());
+		model.optimizeInBatches(bestPoint);
 
 		pipeline::settings::preprocessor_settings_t psettings = model.getPreprocessorSettings();
         pipeline::settings::localizer_settings_t lsettings = model.getLocalizerSettings();
@@ -176,6 +215,9 @@ void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOpt
 
 		const auto result = model.evaluate(lsettings, psettings);
 
+		model.getPreprocessorCache().print();
+		model.getScoreCache().print();
+
 		if (result) {
 			std::cout << bestPoint << std::endl;
 			psettings.print();
@@ -210,28 +252,25 @@ void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOpt
 	auto optimizeEllipseFitter = [&]() {
         //Util::MeasureTimeRAII measureTime;
 
-		pipeline::Preprocessor preprocessor;
-		preprocessor.loadSettings(psettings);
-		pipeline::Localizer localizer;
-		localizer.loadSettings(lsettings);
+        const std::string upstreamSettings = getSettingsString(psettings) + getSettingsString(lsettings);
+        const boost::filesystem::path taglistPath = getTaglistPath(task.outputFolder, "localizer", upstreamSettings);
 
-        OptimizationModel::TaglistByImage taglistByImage;
-        for (auto const& groundTruthImagePair : task.imageFilesByGroundTruthFile) {
-            const auto& imagePathVector = groundTruthImagePair.second;
+        if (auto storedTaglists = loadTaglists(taglistPath, upstreamSettings, *dataset)) {
+            std::cout << "Using localizer taglists from: " << taglistPath << std::endl;
+            dataset->setTaglists(Dataset::Stage::Localizer, std::move(storedTaglists.get()));
+        } else {
+            dataset->setTaglists(Dataset::Stage::Localizer, computeLocalizerTaglists(*dataset, psettings, lsettings));
 
-            for (boost::filesystem::path const& imagePath : imagePathVector) {
-                cv::Mat image = cv::imread(imagePath.string(), CV_LOAD_IMAGE_GRAYSCALE);
-                pipeline::PreprocessorResult preprocessed = preprocessor.process(image);
-                taglist_t taglist = localizer.process(std::move(preprocessed));
-
-                taglistByImage.insert({imagePath, taglist});
-            }
+            saveTaglists(*dataset, Dataset::Stage::Localizer, upstreamSettings, taglistPath);
         }
 
-        EllipseFitterModel model(params, task, taglistByImage);
+        EllipseFitterModel model(params, dataset, modelOptions);
+        model.setCheckpointPath(getCheckpointPath("ellipsefitter"));
+        model.setTelemetrySink(getTelemetrySink("ellipsefitter"));
+        setCurrentStage("ellipsefitter");
 
-		boost::numeric::ublas::vector<double> bestPoint(model.getNumDimensions());
-		model.optimize(bestPoint);
+		boost::numeric::ublas::vector<double> bestPoint(model.getNumQueryDimensions());
+		model.optimizeInBatches(bestPoint);
 
 		pipeline::settings::ellipsefitter_settings_t esettings;
 
@@ -239,6 +278,8 @@ void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOpt
 
 		const auto result = model.evaluate(esettings);
 
+		model.getScoreCache().print();
+
 		if (result) {
 			std::cout << bestPoint << std::endl;
 			esettings.print();
@@ -267,36 +308,26 @@ void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOpt
 	auto optimizeGridFitter = [&]() {
         //Util::MeasureTimeRAII measureTime;
 
-		pipeline::Preprocessor preprocessor;
-		preprocessor.loadSettings(psettings);
-		pipeline::Localizer localizer;
-		localizer.loadSettings(lsettings);
-		pipeline::EllipseFitter ellipseFitter;
-		ellipseFitter.loadSettings(esettings);
-
-        OptimizationModel::TaglistByImage taglistByImage;
-        for (auto const& groundTruthImagePair : task.imageFilesByGroundTruthFile) {
-            const auto& imagePathVector = groundTruthImagePair.second;
-
-            for (boost::filesystem::path const& imagePath : imagePathVector) {
-                cv::Mat image = cv::imread(imagePath.string(), CV_LOAD_IMAGE_GRAYSCALE);
-                pipeline::PreprocessorResult preprocessed = preprocessor.process(image);
-                taglist_t taglistLocalizer = localizer.process(std::move(preprocessed));
-
-                taglist_t taglist = taglistLocalizer;
-                taglist = ellipseFitter.process(std::move(taglist));
-                taglist.erase(
-                            std::remove_if(taglist.begin(), taglist.end(),
-                                           [](pipeline::Tag const& tag) { return tag.getCandidatesConst().empty(); }));
-
-                taglistByImage.insert({imagePath, taglist});
-            }
+        const std::string upstreamSettings =
+                getSettingsString(psettings) + getSettingsString(lsettings) + getSettingsString(esettings);
+        const boost::filesystem::path taglistPath = getTaglistPath(task.outputFolder, "ellipsefitter", upstreamSettings);
+
+        if (auto storedTaglists = loadTaglists(taglistPath, upstreamSettings, *dataset)) {
+            std::cout << "Using ellipseFitter taglists from: " << taglistPath << std::endl;
+            dataset->setTaglists(Dataset::Stage::EllipseFitter, std::move(storedTaglists.get()));
+        } else {
+            dataset->setTaglists(Dataset::Stage::EllipseFitter, computeEllipseFitterTaglists(*dataset, psettings, lsettings, esettings));
+
+            saveTaglists(*dataset, Dataset::Stage::EllipseFitter, upstreamSettings, taglistPath);
         }
 
-        GridfitterModel model(params, task, taglistByImage);
+        GridfitterModel model(params, dataset, modelOptions);
+        model.setCheckpointPath(getCheckpointPath("gridfitter"));
+        model.setTelemetrySink(getTelemetrySink("gridfitter"));
+        setCurrentStage("gridfitter");
 
-		boost::numeric::ublas::vector<double> bestPoint(model.getNumDimensions());
-		model.optimize(bestPoint);
+		boost::numeric::ublas::vector<double> bestPoint(model.getNumQueryDimensions());
+		model.optimizeInBatches(bestPoint);
 
 		pipeline::settings::gridfitter_settings_t gsettings;
 
@@ -304,6 +335,8 @@ void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOpt
 
 		const auto result = model.evaluate(gsettings);
 
+		model.getScoreCache().print();
+
 		if (result) {
 			std::cout << bestPoint << std::endl;
 			gsettings.print();
@@ -334,6 +367,8 @@ void optimizeParameters(const multiple_path_struct_t &task, const CommandLineOpt
 	gsettings.addToPTree(pt);
 
 	boost::property_tree::write_json((task.outputFolder / "settings.json").string(), pt);
+
+	setCurrentStage("finished");
 }
 
 std::string getDateTime()
@@ -363,35 +398,102 @@ int main(int argc, char **argv) {
 
     bopt_params boptParams = getBoptParams(options.get());
 
-    if ((*options).optimize_mean) {
-        multiple_path_struct_t task = getTasks(options.get().data);
+    boost::optional<boost::filesystem::path> resumeFolder;
+    if (options.get().resume) {
+        resumeFolder = boost::filesystem::path(options.get().resume.get());
 
-        optimizeParameters(task, options.get(), boptParams);
-    } else {
-        // TODO: refactor duplicate code
+        if (!boost::filesystem::is_directory(resumeFolder.get())) {
+            std::cout << "Invalid resume path." << std::endl << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // the run folder is matched by its parent, which is only reliable for
+        // a path without trailing separators, dots or links
+        resumeFolder = boost::filesystem::canonical(resumeFolder.get());
+    }
 
-        namespace fs = boost::filesystem;
+    namespace fs = boost::filesystem;
 
-        std::set<fs::path> files;
-        std::copy(fs::recursive_directory_iterator(options.get().data), fs::recursive_directory_iterator(),
-                  std::inserter(files, files.begin()));
+    const fs::path dataFolder(options.get().data);
 
-        for (const fs::path entry : files) {
+    const DatasetManifest manifest = DatasetManifest::loadAndUpdate(dataFolder);
+    const DatasetManifest::ImageFilesByGroundTruthFile imageFilesByGroundTruthFile =
+            manifest.getImageFilesByGroundTruthFile();
 
-            if (fs::is_regular_file(entry)) {
+    if ((*options).optimize_mean) {
+        if (resumeFolder && !isRunFolderOf(resumeFolder.get(), dataFolder)) {
+            std::cout << "Resume path " << resumeFolder.get().string() << " is not a run folder of "
+                      << dataFolder.string() << "." << std::endl << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        multiple_path_struct_t task = getTasks(dataFolder, imageFilesByGroundTruthFile, resumeFolder);
+
+        optimizeParameters(task, options.get(), boptParams, true);
+    } else {
+        // one job per folder that contains ground truth files, a job uses all
+        // ground truth files in its folder and subfolders
+        std::set<fs::path> folders;
+        for (auto const& groundTruthImagesPair : imageFilesByGroundTruthFile) {
+            folders.insert(groundTruthImagesPair.first.parent_path());
+        }
+
+        if (resumeFolder && std::none_of(folders.begin(), folders.end(), [&](fs::path const& folder) {
+                return isRunFolderOf(resumeFolder.get(), folder);
+            })) {
+            std::cout << "Resume path " << resumeFolder.get().string()
+                      << " is not a run folder of any folder with ground truth files." << std::endl << std::endl;
+            return EXIT_FAILURE;
+        }
 
-                if (entry.extension() == ".tdat") {
-                    fs::path groundTruthPath(entry);
+        const size_t numJobs = std::max<size_t>(1, std::min(options.get().num_jobs, folders.size()));
 
-                    if (fs::is_regular_file(groundTruthPath)) {
-                        std::cout << "Optimizing: " << groundTruthPath.string() << std::endl;
+        // concurrent jobs share the thread budget and the memory budget of
+        // the preprocessor caches. the decoded images are not part of the
+        // budget, every job keeps all images of its folder in memory.
+        CommandLineOptions jobOptions = options.get();
+        jobOptions.num_threads = std::max<size_t>(1, options.get().num_threads / numJobs);
+        jobOptions.preprocessor_cache_mb = options.get().preprocessor_cache_mb / numJobs;
 
-                        multiple_path_struct_t task = getTasks(groundTruthPath.parent_path());
+        JobScheduler scheduler(numJobs);
 
-                        optimizeParameters(task, options.get(), boptParams);
+        for (fs::path const& folder : folders) {
+            DatasetManifest::ImageFilesByGroundTruthFile folderImageFiles;
+            for (auto const& groundTruthImagesPair : imageFilesByGroundTruthFile) {
+                const fs::path& groundTruthPath = groundTruthImagesPair.first;
+
+                for (fs::path parent = groundTruthPath.parent_path(); !parent.empty(); parent = parent.parent_path()) {
+                    if (parent == folder) {
+                        folderImageFiles.insert(groundTruthImagesPair);
+                        break;
                     }
                 }
             }
+
+            const multiple_path_struct_t task = getTasks(folder, folderImageFiles, resumeFolder);
+
+            scheduler.addJob(folder.string(), [task, jobOptions, boptParams, numJobs]() {
+                optimizeParameters(task, jobOptions, boptParams, numJobs == 1);
+            });
+        }
+
+        // the output of concurrent jobs can not be told apart, it is
+        // captured once for all of them
+        std::unique_ptr<AsyncLogger> logger;
+        std::unique_ptr<StdErrHandler> err;
+        std::unique_ptr<StdOutHandler> out;
+        if (numJobs > 1) {
+            logger = std::make_unique<AsyncLogger>(dataFolder / "scheduler.log");
+            err = std::make_unique<StdErrHandler>([&](const char* line){
+                logger->log(AsyncLogger::Level::Error, line);
+            });
+            out = std::make_unique<StdOutHandler>([&](const char* line){
+                logger->log(AsyncLogger::Level::Info, line);
+            });
+        }
+
+        if (scheduler.run() > 0) {
+            return EXIT_FAILURE;
         }
     }
 
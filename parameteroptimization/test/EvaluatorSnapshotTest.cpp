@@ -0,0 +1,114 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "Dataset.h"
+#include "DatasetManifest.h"
+#include "EllipseFitterModel.h"
+#include "TaglistStore.h"
+
+namespace {
+
+size_t numFailures = 0;
+
+void check(bool condition, std::string const& description) {
+    if (!condition) {
+        std::cerr << "FAILED: " << description << std::endl;
+        ++numFailures;
+    }
+}
+
+bool isClose(double a, double b) {
+    return std::abs(a - b) < 1e-9;
+}
+
+// evaluates the ellipse fitter on every image without snapshots, in the same
+// way as the model did before the snapshots were introduced
+opt::EllipseFitterResult evaluateReference(opt::Dataset const& dataset,
+                                           pipeline::settings::ellipsefitter_settings_t const& settings) {
+    pipeline::EllipseFitter ellipseFitter;
+    ellipseFitter.loadSettings(settings);
+
+    std::vector<opt::OptimizationResult> results;
+    for (size_t imageIdx = 0; imageIdx < dataset.getNumImages(); ++imageIdx) {
+        opt::Dataset::Image const& image = dataset.getImage(imageIdx);
+
+        GroundTruthEvaluation evaluator(
+                    GroundTruthEvaluation::ResultsByFrame(dataset.getGroundTruth(image.groundTruthIdx)));
+
+        std::vector<pipeline::Tag> tags(dataset.getTaglist(opt::Dataset::Stage::Localizer, imageIdx));
+        evaluator.evaluateLocalizer(image.frameNumber, tags);
+
+        tags = ellipseFitter.process(std::move(tags));
+        evaluator.evaluateEllipseFitter(tags);
+
+        const auto ellipseFitterResult = evaluator.getEllipsefitterResults();
+        results.push_back(opt::getOptimizationResult(ellipseFitterResult.taggedGridsOnFrame.size(),
+                                                     ellipseFitterResult.truePositives.size(),
+                                                     ellipseFitterResult.falsePositives.size(), 0.5));
+    }
+
+    return opt::EllipseFitterResult(results, settings);
+}
+
+void checkResult(boost::optional<opt::EllipseFitterResult> const& result, opt::EllipseFitterResult const& reference,
+                 std::string const& description) {
+    check(static_cast<bool>(result), description + " has a result");
+    if (!result) return;
+
+    check(isClose(result->fscore, reference.fscore), description + " has the reference fscore");
+    check(isClose(result->recall, reference.recall), description + " has the reference recall");
+    check(isClose(result->precision, reference.precision), description + " has the reference precision");
+}
+}
+
+/**
+ * evaluates the ellipse fitter model, which starts every evaluation of an
+ * image from a snapshot of its localizer matching, on a generated dataset and
+ * compares the results with an evaluation without snapshots. the snapshots
+ * refer to the localizer taglists, build with -DSANITIZE_ADDRESS=ON to detect
+ * references to freed tags.
+ */
+int main(int argc, char **argv) {
+    if (argc != 2 || !boost::filesystem::is_directory(argv[1])) {
+        std::cerr << "Usage: " << argv[0] << " <generated data folder>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    opt::multiple_path_struct_t task;
+    task.imageFilesByGroundTruthFile = opt::DatasetManifest::loadAndUpdate(argv[1]).getImageFilesByGroundTruthFile();
+    task.outputFolder = argv[1];
+
+    const auto dataset = std::make_shared<opt::Dataset>(task);
+    check(dataset->getNumImages() > 0, "the dataset has images");
+
+    dataset->setTaglists(opt::Dataset::Stage::Localizer,
+                         opt::computeLocalizerTaglists(*dataset, pipeline::settings::preprocessor_settings_t(),
+                                                       pipeline::settings::localizer_settings_t()));
+
+    opt::ModelOptions options;
+    options.num_threads = 2;
+
+    pipeline::settings::ellipsefitter_settings_t settings;
+    const opt::EllipseFitterResult reference = evaluateReference(*dataset, settings);
+
+    {
+        opt::EllipseFitterModel model(initialize_parameters_to_default(), dataset, options);
+
+        // the second evaluation restores the snapshots into the evaluators
+        // left over from the first one
+        checkResult(model.evaluate(settings), reference, "first evaluation");
+        checkResult(model.evaluate(settings), reference, "second evaluation");
+    }
+
+    if (numFailures) {
+        std::cerr << numFailures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
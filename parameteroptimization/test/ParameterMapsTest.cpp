@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "OptimizationModel.h"
+
+namespace {
+
+size_t numFailures = 0;
+
+void check(bool condition, std::string const& description) {
+    if (!condition) {
+        std::cerr << "FAILED: " << description << std::endl;
+        ++numFailures;
+    }
+}
+
+typedef opt::OptimizationModel::ParameterMaps ParameterMaps;
+
+ParameterMaps getParameterMaps() {
+    ParameterMaps parameterMaps;
+    opt::OptimizationModel::addLimitToParameter("a", {0, 1}, parameterMaps);
+    opt::OptimizationModel::addLimitToParameter("b", {2, 2}, parameterMaps);
+    opt::OptimizationModel::addLimitToParameter("c", {3, 5}, parameterMaps);
+    opt::OptimizationModel::addLimitToParameter("d", {7, 7}, parameterMaps);
+    opt::OptimizationModel::addLimitToParameter("e", {0, 9}, parameterMaps);
+
+    return parameterMaps;
+}
+
+void testQueryIndicesInInsertionOrder() {
+    ParameterMaps parameterMaps = getParameterMaps();
+
+    check(parameterMaps.queryIdxByParameter.size() == 5, "every parameter has a query index");
+    check(parameterMaps.queryIdxByParameter.at("a") == 0, "first parameter has index 0");
+    check(parameterMaps.queryIdxByParameter.at("b") == 1, "second parameter has index 1");
+    check(parameterMaps.queryIdxByParameter.at("e") == 4, "last parameter has index 4");
+
+    opt::OptimizationModel::addLimitToParameter("a", {5, 6}, parameterMaps);
+    check(parameterMaps.queryIdxByParameter.at("a") == 0, "adding a parameter again keeps its index");
+    check(parameterMaps.limitsByParameter.at("a").max == 1, "adding a parameter again keeps its limits");
+}
+
+void testPinConstantParameters() {
+    ParameterMaps parameterMaps = getParameterMaps();
+    parameterMaps.pinConstantParameters();
+
+    check(parameterMaps.getNumFreeParameters() == 3, "three parameters are free");
+    check(parameterMaps.queryIdxByParameter.size() == 3, "pinned parameters are removed from the query");
+    check(parameterMaps.limitsByParameter.size() == 5, "pinned parameters keep their limits");
+
+    check(parameterMaps.queryIdxByParameter.at("a") == 0, "free parameters keep their order (a)");
+    check(parameterMaps.queryIdxByParameter.at("c") == 1, "free parameters keep their order (c)");
+    check(parameterMaps.queryIdxByParameter.at("e") == 2, "free parameters keep their order (e)");
+
+    boost::numeric::ublas::vector<double> query(3);
+    query[0] = 0.1;
+    query[1] = 0.2;
+    query[2] = 0.3;
+
+    check(parameterMaps.getQueryValue("a", query) == 0.1, "query value of a round trips");
+    check(parameterMaps.getQueryValue("c", query) == 0.2, "query value of c round trips");
+    check(parameterMaps.getQueryValue("e", query) == 0.3, "query value of e round trips");
+    check(parameterMaps.getQueryValue("b", query) == 0., "pinned parameters have query value 0");
+    check(parameterMaps.limitsByParameter.at("d").getVal<int>(parameterMaps.getQueryValue("d", query)) == 7,
+          "pinned parameters map to their constant value");
+}
+}
+
+int main() {
+    testQueryIndicesInInsertionOrder();
+    testPinConstantParameters();
+
+    if (numFailures) {
+        std::cerr << numFailures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+#include <sys/resource.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "Dataset.h"
+#include "DatasetManifest.h"
+#include "EllipseFitterModel.h"
+#include "GridFitterModel.h"
+#include "LocalizerModel.h"
+#include "TaglistStore.h"
+#include "Telemetry.h"
+
+namespace {
+
+// keeps all records in memory
+class CollectingTelemetrySink : public opt::TelemetrySink {
+  public:
+    virtual void write(opt::EvaluationRecord const& record) override {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _records.push_back(record);
+    }
+
+    std::vector<opt::EvaluationRecord> takeRecords() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<opt::EvaluationRecord> records;
+        records.swap(_records);
+        return records;
+    }
+
+  private:
+    std::mutex _mutex;
+    std::vector<opt::EvaluationRecord> _records;
+};
+
+struct BenchmarkResult {
+    std::string model;
+    size_t numImages;
+    size_t numEvaluations;
+    size_t numCachedEvaluations;
+    double seconds;
+    double evaluationsPerSecond;
+    // per-image latency percentiles (unit: ms)
+    std::vector<std::pair<std::string, double>> imageLatencies;
+    // peak resident set size of the process after the benchmark (unit: KB)
+    long peakRss;
+};
+
+long getPeakRss() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// nearest rank percentile of sorted values
+double getPercentile(std::vector<double> const& sortedValues, double percentile) {
+    if (sortedValues.empty()) return 0.;
+
+    const size_t rank = static_cast<size_t>(std::ceil(percentile / 100. * sortedValues.size()));
+    return sortedValues[std::min(sortedValues.size() - 1, std::max<size_t>(1, rank) - 1)];
+}
+
+/**
+ * evaluates random queries (uniform in the unit cube, fixed seed) with all
+ * workers of the model. the warmup evaluations fill the caches of the model
+ * and are not measured.
+ */
+BenchmarkResult benchmark(std::string const& name, opt::OptimizationModel& model, size_t numImages,
+                          size_t numEvaluations, size_t numWarmup, unsigned seed) {
+    auto sink = std::make_shared<CollectingTelemetrySink>();
+    model.setTelemetrySink(sink);
+
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> distribution(0., 1.);
+
+    auto getRandomQuery = [&]() {
+        boost::numeric::ublas::vector<double> query(model.getNumQueryDimensions());
+        for (double& value : query) {
+            value = distribution(generator);
+        }
+        return query;
+    };
+
+    for (size_t i = 0; i < numWarmup; ++i) {
+        model.evaluateQuery(getRandomQuery(), model.getAllWorkers(), opt::OptimizationModel::Fidelity::Full);
+    }
+    sink->takeRecords();
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numEvaluations; ++i) {
+        model.evaluateQuery(getRandomQuery(), model.getAllWorkers(), opt::OptimizationModel::Fidelity::Full);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> imageLatencies;
+    size_t numCachedEvaluations = 0;
+    for (opt::EvaluationRecord const& record : sink->takeRecords()) {
+        if (record.cached) {
+            ++numCachedEvaluations;
+            continue;
+        }
+        imageLatencies.insert(imageLatencies.end(), record.stageTimes.imageMilliseconds.begin(),
+                              record.stageTimes.imageMilliseconds.end());
+    }
+    std::sort(imageLatencies.begin(), imageLatencies.end());
+
+    BenchmarkResult result;
+    result.model                = name;
+    result.numImages            = numImages;
+    result.numEvaluations       = numEvaluations;
+    result.numCachedEvaluations = numCachedEvaluations;
+    result.seconds              = seconds;
+    result.evaluationsPerSecond = numEvaluations / std::max(seconds, 1e-9);
+    for (double percentile : {50., 90., 99.}) {
+        std::stringstream key;
+        key << "p" << percentile;
+        result.imageLatencies.emplace_back(key.str(), getPercentile(imageLatencies, percentile));
+    }
+    result.imageLatencies.emplace_back("max", imageLatencies.empty() ? 0. : imageLatencies.back());
+    result.peakRss = getPeakRss();
+
+    std::cout << name << ": " << result.evaluationsPerSecond << " evaluations/s, per-image latency";
+    for (auto const& latency : result.imageLatencies) {
+        std::cout << " " << latency.first << "=" << latency.second << "ms";
+    }
+    std::cout << ", peak RSS " << result.peakRss << "KB" << std::endl;
+
+    return result;
+}
+
+void writeJson(std::vector<BenchmarkResult> const& results, size_t numThreads, boost::filesystem::path const& path) {
+    std::ofstream os(path.string());
+
+    os << "{\n  \"num_threads\": " << numThreads << ",\n  \"models\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        BenchmarkResult const& result = results[i];
+
+        os << (i ? "," : "") << "\n    {\n"
+           << "      \"model\": \"" << result.model << "\",\n"
+           << "      \"num_images\": " << result.numImages << ",\n"
+           << "      \"num_evaluations\": " << result.numEvaluations << ",\n"
+           << "      \"num_cached_evaluations\": " << result.numCachedEvaluations << ",\n"
+           << "      \"seconds\": " << result.seconds << ",\n"
+           << "      \"evaluations_per_second\": " << result.evaluationsPerSecond << ",\n"
+           << "      \"image_latency_ms\": {";
+        for (size_t j = 0; j < result.imageLatencies.size(); ++j) {
+            os << (j ? ", " : " ") << "\"" << result.imageLatencies[j].first << "\": "
+               << result.imageLatencies[j].second;
+        }
+        os << " },\n"
+           << "      \"peak_rss_kb\": " << result.peakRss << "\n"
+           << "    }";
+    }
+    os << "\n  ]\n}\n";
+}
+}
+
+/**
+ * measures the throughput of the objective functions of all models on a fixed
+ * dataset. the ellipse fitter and grid fitter models use taglists generated
+ * with the default settings.
+ */
+int main(int argc, char **argv) {
+    namespace fs = boost::filesystem;
+    namespace po = boost::program_options;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help", "produce help message")
+            ("data", po::value<std::string>(), "data folder")
+            ("evaluations", po::value<size_t>()->default_value(20), "number of measured evaluations per model")
+            ("warmup", po::value<size_t>()->default_value(1), "number of unmeasured evaluations per model")
+            ("num_threads", po::value<size_t>()->default_value(opt::getDefaultNumThreads()), "number of worker threads")
+            ("seed", po::value<unsigned>()->default_value(0), "seed of the random queries")
+            ("output", po::value<std::string>()->default_value("benchmark.json"), "JSON output file");
+
+    po::positional_options_description p;
+    p.add("data", 1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || !vm.count("data") || !fs::is_directory(vm["data"].as<std::string>())) {
+        std::cout << desc << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const fs::path dataFolder(vm["data"].as<std::string>());
+    const size_t numEvaluations = vm["evaluations"].as<size_t>();
+    const size_t numWarmup      = vm["warmup"].as<size_t>();
+    const unsigned seed         = vm["seed"].as<unsigned>();
+
+    opt::multiple_path_struct_t task;
+    task.imageFilesByGroundTruthFile = opt::DatasetManifest::loadAndUpdate(dataFolder).getImageFilesByGroundTruthFile();
+    task.outputFolder = dataFolder;
+
+    const auto dataset = std::make_shared<opt::Dataset>(task);
+    const size_t numImages = dataset->getNumImages();
+
+    if (!numImages) {
+        std::cerr << "No images with ground truth found in " << dataFolder.string() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    opt::ModelOptions options;
+    options.num_threads = std::max<size_t>(1, vm["num_threads"].as<size_t>());
+
+    const bopt_params params = initialize_parameters_to_default();
+
+    std::vector<BenchmarkResult> results;
+
+    pipeline::settings::preprocessor_settings_t psettings;
+    pipeline::settings::localizer_settings_t lsettings;
+    {
+        opt::LocalizerModel model(params, dataset, options, boost::none);
+        psettings = model.getPreprocessorSettings();
+        lsettings = model.getLocalizerSettings();
+
+        results.push_back(benchmark("localizer", model, numImages, numEvaluations, numWarmup, seed));
+    }
+
+    const pipeline::settings::ellipsefitter_settings_t esettings;
+    {
+        dataset->setTaglists(opt::Dataset::Stage::Localizer,
+                             opt::computeLocalizerTaglists(*dataset, psettings, lsettings));
+
+        opt::EllipseFitterModel model(params, dataset, options);
+
+        results.push_back(benchmark("ellipsefitter", model, numImages, numEvaluations, numWarmup, seed));
+    }
+
+    {
+        dataset->setTaglists(opt::Dataset::Stage::EllipseFitter,
+                             opt::computeEllipseFitterTaglists(*dataset, psettings, lsettings, esettings));
+
+        opt::GridfitterModel model(params, dataset, options);
+
+        results.push_back(benchmark("gridfitter", model, numImages, numEvaluations, numWarmup, seed));
+    }
+
+    writeJson(results, options.num_threads, vm["output"].as<std::string>());
+
+    return EXIT_SUCCESS;
+}
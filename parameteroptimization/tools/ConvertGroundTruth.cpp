@@ -0,0 +1,67 @@
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+#include "GroundTruth.h"
+#include "Grid3D.h"
+
+namespace Serialization = BioTracker::Core::Serialization;
+using BioTracker::Core::TrackedObject;
+
+namespace {
+size_t getNumGrids(Serialization::Data const& data) {
+    size_t numGrids = 0;
+
+    for (TrackedObject const& object : data.getTrackedObjects()) {
+        for (size_t frameNumber = 0; frameNumber <= object.getLastFrameNumber(); ++frameNumber) {
+            if (object.maybeGet<Grid3D>(frameNumber)) {
+                ++numGrids;
+            }
+        }
+    }
+
+    return numGrids;
+}
+
+void convert(boost::filesystem::path const& groundTruthPath) {
+    const Serialization::Data data = opt::loadJsonGroundTruth(groundTruthPath);
+    const boost::filesystem::path binaryPath = opt::getBinaryGroundTruthPath(groundTruthPath);
+
+    opt::writeBinaryGroundTruth(data, binaryPath);
+
+    std::cout << groundTruthPath.string() << " -> " << binaryPath.string() << " ("
+              << getNumGrids(data) << " grids)" << std::endl;
+}
+}
+
+/**
+ * converts all .tdat ground truth files in the given files or folders
+ * (recursively) into the binary ground truth format
+ */
+int main(int argc, char **argv) {
+    namespace fs = boost::filesystem;
+
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <.tdat file or folder>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const fs::path path(argv[i]);
+
+        if (fs::is_directory(path)) {
+            for (fs::recursive_directory_iterator it(path), end; it != end; ++it) {
+                if (fs::is_regular_file(it->path()) && it->path().extension() == ".tdat") {
+                    convert(it->path());
+                }
+            }
+        } else if (fs::is_regular_file(path)) {
+            convert(path);
+        } else {
+            std::cerr << "Invalid path: " << path.string() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <biotracker/serialization/SerializationData.h>
+
+#include "GroundTruth.h"
+#include "Grid3D.h"
+
+namespace Serialization = BioTracker::Core::Serialization;
+using BioTracker::Core::TrackedObject;
+
+namespace {
+
+struct GeneratorOptions {
+    size_t numFrames;
+    size_t framesPerFile;
+    size_t tagsPerFrame;
+    int width;
+    int height;
+    double tagRadius;
+    double occlusionProbability;
+    double noise;
+};
+
+// dark ellipse drawn over a tag
+struct Occluder {
+    cv::Point2d center;
+    cv::Size2d axes;
+    // unit: degrees, as in cv::ellipse
+    double angle;
+    double color;
+};
+
+std::string getName(char const* format, size_t index) {
+    char name[64];
+    std::snprintf(name, sizeof(name), format, index);
+    return name;
+}
+
+// true if p lies within the rotated ellipse (angle in degrees, as in cv::ellipse)
+bool isInEllipse(cv::Point2d const& p, cv::Point2d const& center, cv::Size2d const& axes, double angle) {
+    const double rad = angle * CV_PI / 180.;
+    const cv::Point2d d = p - center;
+    const double x = d.x * std::cos(rad) + d.y * std::sin(rad);
+    const double y = -d.x * std::sin(rad) + d.y * std::cos(rad);
+
+    return (x * x) / (axes.width * axes.width) + (y * y) / (axes.height * axes.height) <= 1.;
+}
+
+/**
+ * renders one ground truth file with its frames into folder. every tracked
+ * object keeps its id in all frames, its pose is drawn at random in every
+ * frame. objects that can not be placed without overlapping other tags are
+ * missing in that frame.
+ */
+void generateFile(GeneratorOptions const& options, size_t firstFrame, size_t numFrames,
+                  boost::filesystem::path const& folder, std::mt19937& generator, cv::RNG& rng) {
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::normal_distribution<double> tilt(0., 0.25);
+    std::bernoulli_distribution bit(0.5);
+
+    std::vector<Grid3D::idarray_t> ids(options.tagsPerFrame);
+    for (Grid3D::idarray_t& id : ids) {
+        for (boost::tribool& value : id) {
+            value = bit(generator);
+        }
+    }
+
+    std::vector<TrackedObject> objects;
+    for (size_t objectIdx = 0; objectIdx < options.tagsPerFrame; ++objectIdx) {
+        objects.emplace_back(objectIdx);
+    }
+
+    std::vector<std::string> filenames;
+
+    for (size_t frameNumber = 0; frameNumber < numFrames; ++frameNumber) {
+        cv::Mat image(options.height, options.width, CV_8UC1, cv::Scalar(70));
+
+        // all tags of the frame are placed first, so that their meshes can be
+        // projected in a single batch before they are rendered
+        std::vector<std::shared_ptr<Grid3D>> grids;
+        std::vector<boost::optional<Occluder>> occluders;
+
+        std::vector<cv::Point2d> centers;
+        for (size_t objectIdx = 0; objectIdx < options.tagsPerFrame; ++objectIdx) {
+            const double radius = options.tagRadius * (0.9 + 0.2 * uniform(generator));
+
+            // rejection sampling of a position that does not overlap other tags
+            const double margin = 1.5 * options.tagRadius;
+            boost::optional<cv::Point2d> center;
+            for (size_t attempt = 0; attempt < 20 && !center; ++attempt) {
+                const cv::Point2d candidate(margin + uniform(generator) * (options.width - 2 * margin),
+                                            margin + uniform(generator) * (options.height - 2 * margin));
+
+                bool overlaps = false;
+                for (cv::Point2d const& other : centers) {
+                    overlaps |= cv::norm(candidate - other) < 2.5 * options.tagRadius;
+                }
+
+                if (!overlaps) center = candidate;
+            }
+
+            if (!center) continue;
+            centers.push_back(center.get());
+
+            const auto grid = std::make_shared<Grid3D>(
+                        cv::Point2i(static_cast<int>(center->x), static_cast<int>(center->y)), radius,
+                        (2. * uniform(generator) - 1.) * CV_PI, tilt(generator), tilt(generator));
+
+            for (size_t cell = 0; cell < Grid3D::NUM_MIDDLE_CELLS; ++cell) {
+                if (ids[objectIdx][cell]) {
+                    grid->toggleIdBit(cell, false);
+                }
+            }
+            grid->setBeenBitToggled(boost::logic::tribool::true_value);
+
+            // a dark ellipse (a leg or another bee) covers part of the tag, the
+            // tag is not recognizable if its center is covered
+            boost::optional<Occluder> occluder;
+            if (uniform(generator) < options.occlusionProbability) {
+                const cv::Point2d occluderCenter = center.get() + radius * cv::Point2d(2. * uniform(generator) - 1.,
+                                                                                        2. * uniform(generator) - 1.);
+                const cv::Size2d axes(radius * (0.5 + 0.5 * uniform(generator)),
+                                      radius * (0.2 + 0.3 * uniform(generator)));
+                const double angle = 360. * uniform(generator);
+
+                occluder = Occluder{occluderCenter, axes, angle, 20 + 40 * uniform(generator)};
+
+                if (isInEllipse(center.get(), occluderCenter, axes, angle)) {
+                    grid->setSettable(false);
+                }
+            }
+
+            objects[objectIdx].add(frameNumber, grid);
+
+            grids.push_back(grid);
+            occluders.push_back(occluder);
+        }
+
+        std::vector<Grid3D*> gridPtrs;
+        for (auto const& grid : grids) {
+            gridPtrs.push_back(grid.get());
+        }
+        Grid3D::prepareVisualizationData(gridPtrs);
+
+        for (size_t i = 0; i < grids.size(); ++i) {
+            grids[i]->render(image);
+
+            if (occluders[i]) {
+                Occluder const& occluder = occluders[i].get();
+                cv::ellipse(image, cv::Point(occluder.center), cv::Size(occluder.axes), occluder.angle, 0., 360.,
+                            cv::Scalar(occluder.color), -1, CV_AA);
+            }
+        }
+
+        cv::GaussianBlur(image, image, cv::Size(3, 3), 0.);
+
+        cv::Mat noise(image.size(), CV_16SC1);
+        rng.fill(noise, cv::RNG::NORMAL, 0., options.noise);
+
+        cv::Mat noisyImage;
+        image.convertTo(noisyImage, CV_16SC1);
+        noisyImage += noise;
+        noisyImage.convertTo(image, CV_8UC1);
+
+        const std::string filename = getName("frame_%06zu.jpeg", firstFrame + frameNumber);
+        cv::imwrite((folder / filename).string(), image);
+        filenames.push_back(filename);
+    }
+
+    const Serialization::Data data("BeesBookTagMatcher", "", filenames, objects);
+
+    const boost::filesystem::path groundTruthPath = folder / "ground_truth.tdat";
+    opt::writeJsonGroundTruth(data, groundTruthPath);
+    opt::writeBinaryGroundTruth(data, opt::getBinaryGroundTruthPath(groundTruthPath));
+}
+}
+
+/**
+ * generates a synthetic dataset of grayscale frames with rendered tags and
+ * the matching ground truth. the frames are split into folders of at most
+ * frames_per_file frames with one ground truth file each, so that memory use
+ * does not grow with the size of the dataset.
+ */
+int main(int argc, char **argv) {
+    namespace fs = boost::filesystem;
+    namespace po = boost::program_options;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help", "produce help message")
+            ("output", po::value<std::string>(), "output folder")
+            ("frames", po::value<size_t>()->default_value(1000), "total number of frames")
+            ("frames_per_file", po::value<size_t>()->default_value(1000), "number of frames per ground truth file")
+            ("tags_per_frame", po::value<size_t>()->default_value(10), "number of tags per frame")
+            ("width", po::value<int>()->default_value(1024), "frame width (unit: px)")
+            ("height", po::value<int>()->default_value(768), "frame height (unit: px)")
+            ("tag_radius", po::value<double>()->default_value(24.), "mean tag radius (unit: px)")
+            ("occlusion", po::value<double>()->default_value(0.2), "probability that a tag is partially occluded")
+            ("noise", po::value<double>()->default_value(8.), "standard deviation of the pixel noise")
+            ("seed", po::value<unsigned>()->default_value(0), "random seed");
+
+    po::positional_options_description p;
+    p.add("output", 1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || !vm.count("output")) {
+        std::cout << desc << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    GeneratorOptions options;
+    options.numFrames            = vm["frames"].as<size_t>();
+    options.framesPerFile        = std::max<size_t>(1, vm["frames_per_file"].as<size_t>());
+    options.tagsPerFrame         = vm["tags_per_frame"].as<size_t>();
+    options.width                = vm["width"].as<int>();
+    options.height               = vm["height"].as<int>();
+    options.tagRadius            = vm["tag_radius"].as<double>();
+    options.occlusionProbability = vm["occlusion"].as<double>();
+    options.noise                = vm["noise"].as<double>();
+
+    if (options.width < 4 * options.tagRadius || options.height < 4 * options.tagRadius) {
+        std::cerr << "Frames are too small for the tag radius" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const fs::path outputFolder(vm["output"].as<std::string>());
+    const unsigned seed = vm["seed"].as<unsigned>();
+
+    std::mt19937 generator(seed);
+    cv::RNG rng(seed);
+
+    const size_t numFiles = (options.numFrames + options.framesPerFile - 1) / options.framesPerFile;
+    for (size_t fileIdx = 0; fileIdx < numFiles; ++fileIdx) {
+        const size_t firstFrame = fileIdx * options.framesPerFile;
+        const size_t numFrames  = std::min(options.framesPerFile, options.numFrames - firstFrame);
+
+        const fs::path folder = outputFolder / getName("part_%04zu", fileIdx);
+        fs::create_directories(folder);
+
+        generateFile(options, firstFrame, numFrames, folder, generator, rng);
+
+        std::cout << "[" << (fileIdx + 1) << "/" << numFiles << "] " << folder.string()
+                  << " (" << numFrames << " frames)" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}